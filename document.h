@@ -2,6 +2,8 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <vector>
 
 struct Document {
     Document() = default;
@@ -24,4 +26,14 @@ enum class DocumentStatus {
     IRRELEVANT,
     BANNED,
     REMOVED,
+};
+
+constexpr size_t DOCUMENT_STATUS_COUNT = 4;
+
+// Document of a SearchServer::AddDocuments batch; the text is only read during the call
+struct NewDocument {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
 };
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include "document_columns.h"
+
+using namespace std;
+
+DocumentFilter DocumentFilter::ForStatus(DocumentStatus status) {
+    DocumentFilter filter;
+    filter.status_mask = 1u << static_cast<int>(status);
+    return filter;
+}
+
+DocumentFilter DocumentFilter::ForStatuses(initializer_list<DocumentStatus> statuses) {
+    DocumentFilter filter;
+    filter.status_mask = 0;
+    for (const DocumentStatus status : statuses) {
+        filter.status_mask |= 1u << static_cast<int>(status);
+    }
+    return filter;
+}
+
+bool DocumentFilter::operator()(int, DocumentStatus status, int rating) const {
+    return (status_mask >> static_cast<int>(status) & 1) != 0 && rating >= min_rating && rating <= max_rating;
+}
+
+void DocumentColumns::Add(DocumentStatus status, int rating) {
+    const size_t ordinal = statuses_.size();
+    statuses_.push_back(static_cast<uint8_t>(status));
+    ratings_.push_back(rating);
+    if (ordinal % 64 == 0) {
+        for (vector<uint64_t>& bitmap : status_bitmaps_) {
+            bitmap.push_back(0);
+        }
+    }
+    status_bitmaps_[static_cast<int>(status)][ordinal / 64] |= uint64_t{ 1 } << (ordinal % 64);
+}
+
+void DocumentColumns::Remove(int ordinal) {
+    status_bitmaps_[statuses_[ordinal]][ordinal / 64] &= ~(uint64_t{ 1 } << (ordinal % 64));
+}
+
+void DocumentColumns::Reserve(size_t size) {
+    statuses_.reserve(size);
+    ratings_.reserve(size);
+    for (vector<uint64_t>& bitmap : status_bitmaps_) {
+        bitmap.reserve((size + 63) / 64);
+    }
+}
+
+size_t DocumentColumns::Size() const {
+    return statuses_.size();
+}
+
+DocumentStatus DocumentColumns::GetStatus(int ordinal) const {
+    return static_cast<DocumentStatus>(statuses_[ordinal]);
+}
+
+int DocumentColumns::GetRating(int ordinal) const {
+    return ratings_[ordinal];
+}
+
+const int* DocumentColumns::GetRatings() const {
+    return ratings_.data();
+}
+
+const uint64_t* DocumentColumns::GetStatusBitmap(uint32_t status_mask, vector<uint64_t>& buffer) const {
+    for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+        if (status_mask == 1u << status) {
+            return status_bitmaps_[status].data();
+        }
+    }
+    buffer.assign(status_bitmaps_[0].size(), 0);
+    for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+        if ((status_mask >> status & 1) != 0) {
+            for (size_t i = 0; i < buffer.size(); ++i) {
+                buffer[i] |= status_bitmaps_[status][i];
+            }
+        }
+    }
+    return buffer.data();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "document.h"
+
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <vector>
+
+// Documents with one of a set of statuses and a rating in [min_rating, max_rating].
+// SearchServer::FindTopDocuments checks the statuses on bitmaps before scoring;
+// anything else may call it as a predicate.
+struct DocumentFilter {
+    // Bit 1 << status of every accepted status
+    uint32_t status_mask = (1u << DOCUMENT_STATUS_COUNT) - 1;
+    int min_rating = std::numeric_limits<int>::min();
+    int max_rating = std::numeric_limits<int>::max();
+
+    static DocumentFilter ForStatus(DocumentStatus status);
+    static DocumentFilter ForStatuses(std::initializer_list<DocumentStatus> statuses);
+
+    bool operator()(int document_id, DocumentStatus status, int rating) const;
+};
+
+// Statuses and ratings of documents by ordinal in dense arrays, and for every
+// status a bitmap of the ordinals that have it and are not removed.
+class DocumentColumns {
+public:
+    // The document gets ordinal Size()
+    void Add(DocumentStatus status, int rating);
+    // Clears the bit of the document; its status and rating stay
+    void Remove(int ordinal);
+    void Reserve(size_t size);
+
+    size_t Size() const;
+    DocumentStatus GetStatus(int ordinal) const;
+    int GetRating(int ordinal) const;
+    const int* GetRatings() const;
+
+    // Bitmap of the documents having a status of the mask, one bit per ordinal
+    // in 64-bit words. The bitmap of a single status is returned as is, others
+    // are combined into buffer
+    const uint64_t* GetStatusBitmap(uint32_t status_mask, std::vector<uint64_t>& buffer) const;
+
+private:
+    std::vector<uint8_t> statuses_;
+    std::vector<int> ratings_;
+    std::array<std::vector<uint64_t>, DOCUMENT_STATUS_COUNT> status_bitmaps_;
+};
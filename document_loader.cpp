@@ -0,0 +1,251 @@
+#include "document_loader.h"
+
+#include <cerrno>
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+struct Chunk {
+    vector<char> data;
+    // Documents view the text of their records in data
+    vector<NewDocument> documents;
+};
+
+// Pop waits for a chunk; it returns nullptr once the queue is closed and
+// drained, or right away once it is cancelled
+class ChunkQueue {
+public:
+    void Push(unique_ptr<Chunk> chunk) {
+        {
+            lock_guard guard(mutex_);
+            chunks_.push_back(move(chunk));
+        }
+        not_empty_.notify_one();
+    }
+
+    unique_ptr<Chunk> Pop() {
+        unique_lock lock(mutex_);
+        not_empty_.wait(lock, [this] {
+            return !chunks_.empty() || is_closed_ || is_cancelled_;
+        });
+        if (chunks_.empty() || is_cancelled_) {
+            return nullptr;
+        }
+        unique_ptr<Chunk> chunk = move(chunks_.front());
+        chunks_.pop_front();
+        return chunk;
+    }
+
+    void Close() {
+        {
+            lock_guard guard(mutex_);
+            is_closed_ = true;
+        }
+        not_empty_.notify_all();
+    }
+
+    void Cancel() {
+        {
+            lock_guard guard(mutex_);
+            is_cancelled_ = true;
+        }
+        not_empty_.notify_all();
+    }
+
+private:
+    mutex mutex_;
+    condition_variable not_empty_;
+    deque<unique_ptr<Chunk>> chunks_;
+    bool is_closed_ = false;
+    bool is_cancelled_ = false;
+};
+
+bool ParseInt(string_view text, int& value) {
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    return error == errc() && end == text.data() + text.size() && !text.empty();
+}
+
+// The text of the document is a view into the line
+NewDocument ParseRecord(string_view line, size_t line_number) {
+    const auto fail = [line_number] {
+        throw invalid_argument("Invalid record at line "s + to_string(line_number));
+    };
+    string_view fields[3];
+    for (string_view& field : fields) {
+        const size_t tab = line.find('\t');
+        if (tab == line.npos) {
+            fail();
+        }
+        field = line.substr(0, tab);
+        line.remove_prefix(tab + 1);
+    }
+
+    NewDocument document;
+    document.text = line;
+    int status = 0;
+    if (!ParseInt(fields[0], document.id) || !ParseInt(fields[1], status)
+        || status < static_cast<int>(DocumentStatus::ACTUAL) || status > static_cast<int>(DocumentStatus::REMOVED)) {
+        fail();
+    }
+    document.status = static_cast<DocumentStatus>(status);
+    string_view ratings = fields[2];
+    while (!ratings.empty()) {
+        const size_t space = min(ratings.find(' '), ratings.size());
+        if (space > 0) {
+            int rating = 0;
+            if (!ParseInt(ratings.substr(0, space), rating)) {
+                fail();
+            }
+            document.ratings.push_back(rating);
+        }
+        ratings.remove_prefix(min(space + 1, ratings.size()));
+    }
+    return document;
+}
+
+// Parses the lines of text into documents, counting line_number on; empty lines are skipped
+void ParseRecords(string_view text, size_t& line_number, vector<NewDocument>& documents) {
+    while (!text.empty()) {
+        const size_t line_end = min(text.find('\n'), text.size());
+        string_view line = text.substr(0, line_end);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (!line.empty()) {
+            documents.push_back(ParseRecord(line, line_number));
+        }
+        ++line_number;
+        text.remove_prefix(min(line_end + 1, text.size()));
+    }
+}
+
+// Reads into [data, data + size) until it is full or the input ends; returns the bytes read
+size_t ReadFully(int fd, char* data, size_t size) {
+    size_t read_size = 0;
+    while (read_size < size) {
+        const ssize_t result = read(fd, data + read_size, size - read_size);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw system_error(errno, generic_category(), "Cannot read documents"s);
+        }
+        if (result == 0) {
+            break;
+        }
+        read_size += static_cast<size_t>(result);
+    }
+    return read_size;
+}
+
+} // namespace
+
+DocumentLoader::DocumentLoader(SearchServer& search_server)
+    : search_server_(search_server) {
+}
+
+void DocumentLoader::SetChunkSize(size_t chunk_size) {
+    if (chunk_size == 0) {
+        throw invalid_argument("Chunk size must be positive"s);
+    }
+    chunk_size_ = chunk_size;
+}
+
+void DocumentLoader::SetChunkCount(size_t chunk_count) {
+    // The reader holds a chunk while it waits for the next one
+    if (chunk_count < 2) {
+        throw invalid_argument("At least 2 chunks are needed"s);
+    }
+    chunk_count_ = chunk_count;
+}
+
+size_t DocumentLoader::LoadFile(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw system_error(errno, generic_category(), "Cannot open documents "s + path);
+    }
+    struct FileCloser {
+        int fd;
+        ~FileCloser() {
+            close(fd);
+        }
+    } closer{ fd };
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return Load(fd);
+}
+
+size_t DocumentLoader::Load(int fd) {
+    // Chunks go from free_chunks to the reader, to filled_chunks and the consumer, and back
+    ChunkQueue free_chunks;
+    ChunkQueue filled_chunks;
+    for (size_t i = 0; i < chunk_count_; ++i) {
+        free_chunks.Push(make_unique<Chunk>());
+    }
+    auto indexing = async(launch::async, [this, &free_chunks, &filled_chunks] {
+        size_t document_count = 0;
+        try {
+            while (unique_ptr<Chunk> chunk = filled_chunks.Pop()) {
+                search_server_.AddDocuments(std::execution::par, chunk->documents);
+                document_count += chunk->documents.size();
+                free_chunks.Push(move(chunk));
+            }
+        }
+        catch (...) {
+            // Stops the reader waiting for a free chunk
+            free_chunks.Cancel();
+            throw;
+        }
+        return document_count;
+    });
+
+    try {
+        // A record cut by the end of a chunk is moved to the start of the next one
+        size_t carried_size = 0;
+        size_t line_number = 1;
+        unique_ptr<Chunk> chunk = free_chunks.Pop();
+        while (chunk) {
+            chunk->data.resize(chunk_size_);
+            const size_t size = carried_size + ReadFully(fd, chunk->data.data() + carried_size, chunk_size_ - carried_size);
+            const bool at_end = size < chunk_size_;
+            const string_view text(chunk->data.data(), size);
+            // 0 if a full chunk has no line end
+            const size_t records_size = at_end ? size : text.rfind('\n') + 1;
+            if (records_size == 0) {
+                throw invalid_argument("Record at line "s + to_string(line_number) + " does not fit into a chunk"s);
+            }
+            chunk->documents.clear();
+            ParseRecords(text.substr(0, records_size), line_number, chunk->documents);
+
+            unique_ptr<Chunk> next_chunk;
+            if (!at_end) {
+                next_chunk = free_chunks.Pop();
+                if (next_chunk) {
+                    carried_size = size - records_size;
+                    next_chunk->data.resize(chunk_size_);
+                    memcpy(next_chunk->data.data(), text.data() + records_size, carried_size);
+                }
+            }
+            filled_chunks.Push(move(chunk));
+            chunk = move(next_chunk);
+        }
+    }
+    catch (...) {
+        // Chunks read before are still indexed
+        filled_chunks.Close();
+        indexing.wait();
+        throw;
+    }
+    filled_chunks.Close();
+    return indexing.get();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <cstddef>
+#include <string>
+
+// Streams a corpus into a SearchServer with bounded memory. Every line of the
+// input is a record
+//     <id>\t<status>\t<ratings>\t<text>
+// where status is the number of a DocumentStatus and ratings are separated by
+// spaces. The input is read in large chunks that records are parsed from in
+// place; a consumer thread adds every chunk as one AddDocuments batch while
+// the next ones are read. Reading waits once the chunks in flight are used up,
+// so at most SetChunkCount chunks of the input are held at a time.
+class DocumentLoader {
+public:
+    explicit DocumentLoader(SearchServer& search_server);
+
+    // 4 MB by default; a record must fit into a chunk
+    void SetChunkSize(size_t chunk_size);
+    // Chunks being read, queued and indexed at a time, at least 2; 4 by default
+    void SetChunkCount(size_t chunk_count);
+
+    // Both return the number of documents added. A malformed record throws
+    // invalid_argument naming its line, a read error system_error, and a chunk
+    // AddDocuments rejects throws what it threw. The chunks before the failed
+    // one stay added
+    size_t LoadFile(const std::string& path);
+    // Reads the file descriptor until its end, e.g. STDIN_FILENO
+    size_t Load(int fd);
+
+private:
+    SearchServer& search_server_;
+    size_t chunk_size_ = 4 << 20;
+    size_t chunk_count_ = 4;
+};
@@ -0,0 +1,117 @@
+#include "document_positions.h"
+#include "varint.h"
+
+#include <algorithm>
+
+using namespace std;
+
+DocumentPositions::DocumentPositions(const vector<vector<uint32_t>>& term_positions) {
+    vector<uint8_t> data;
+    vector<uint8_t> encoded;
+    for (const vector<uint32_t>& positions : term_positions) {
+        encoded.clear();
+        uint32_t previous = 0;
+        for (const uint32_t position : positions) {
+            WriteVarint(encoded, position - previous);
+            previous = position;
+        }
+        WriteVarint(data, static_cast<uint32_t>(encoded.size()));
+        data.insert(data.end(), encoded.begin(), encoded.end());
+    }
+    data.shrink_to_fit();
+    const auto owned_data = make_shared<const vector<uint8_t>>(move(data));
+    data_ = shared_ptr<const uint8_t>(owned_data, owned_data->data());
+    size_ = owned_data->size();
+}
+
+DocumentPositions::DocumentPositions(const uint8_t* data, size_t size)
+    : data_(shared_ptr<const uint8_t>(), data)
+    , size_(size) {
+}
+
+void DocumentPositions::Decode(size_t term_index, vector<uint32_t>& positions) const {
+    const uint8_t* in = data_.get();
+    for (size_t i = 0; i < term_index; ++i) {
+        const uint32_t size = ReadVarint(in);
+        in += size;
+    }
+    const uint32_t size = ReadVarint(in);
+    const uint8_t* const end = in + size;
+    positions.clear();
+    uint32_t position = 0;
+    while (in < end) {
+        position += ReadVarint(in);
+        positions.push_back(position);
+    }
+}
+
+bool DocumentPositions::IsValid(size_t term_count) const {
+    const uint8_t* in = data_.get();
+    const uint8_t* const end = in + size_;
+    for (size_t i = 0; i < term_count; ++i) {
+        uint32_t size = 0;
+        if (!TryReadVarint(in, end, size) || size > static_cast<size_t>(end - in)) {
+            return false;
+        }
+        const uint8_t* const list_end = in + size;
+        uint32_t delta = 0;
+        while (in < list_end) {
+            if (!TryReadVarint(in, list_end, delta)) {
+                return false;
+            }
+        }
+    }
+    return in == end;
+}
+
+const uint8_t* DocumentPositions::GetData() const {
+    return data_.get();
+}
+
+size_t DocumentPositions::GetSize() const {
+    return size_;
+}
+
+bool HasPhrase(const vector<vector<uint32_t>>& term_positions, const vector<uint32_t>& offsets) {
+    size_t shortest = 0;
+    for (size_t i = 1; i < offsets.size(); ++i) {
+        if (term_positions[i].size() < term_positions[shortest].size()) {
+            shortest = i;
+        }
+    }
+    for (const uint32_t position : term_positions[shortest]) {
+        if (position < offsets[shortest]) {
+            continue;
+        }
+        const uint32_t start = position - offsets[shortest];
+        bool is_found = true;
+        for (size_t i = 0; i < offsets.size() && is_found; ++i) {
+            is_found = i == shortest || binary_search(term_positions[i].begin(), term_positions[i].end(), start + offsets[i]);
+        }
+        if (is_found) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HasProximity(const vector<uint32_t>& lhs, const vector<uint32_t>& rhs, uint32_t max_distance) {
+    // Advancing the smaller position can only bring the lists closer
+    size_t i = 0;
+    size_t j = 0;
+    while (i < lhs.size() && j < rhs.size()) {
+        if (lhs[i] <= rhs[j]) {
+            if (rhs[j] - lhs[i] <= max_distance) {
+                return true;
+            }
+            ++i;
+        }
+        else {
+            if (lhs[i] - rhs[j] <= max_distance) {
+                return true;
+            }
+            ++j;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Word positions of one document, kept for every term of the document in
+// ascending term id order. Every list is delta + varint encoded behind its
+// length in bytes, so a lookup skips the lists before it without decoding them.
+class DocumentPositions {
+public:
+    // term_positions[i] holds the ascending positions of the i-th term
+    explicit DocumentPositions(const std::vector<std::vector<uint32_t>>& term_positions);
+    // Reads the encoded lists in place, as GetData returns them; they must
+    // outlive the object
+    DocumentPositions(const uint8_t* data, size_t size);
+
+    // Replaces positions with those of the i-th term
+    void Decode(size_t term_index, std::vector<uint32_t>& positions) const;
+    // Tells if the data holds exactly term_count well-formed lists, so Decode
+    // stays inside it; for data read from a file
+    bool IsValid(size_t term_count) const;
+    const uint8_t* GetData() const;
+    size_t GetSize() const;
+
+private:
+    // Owned by the object only if it encoded the lists
+    std::shared_ptr<const uint8_t> data_;
+    size_t size_ = 0;
+};
+
+// Tells if some start position p has p + offsets[i] in term_positions[i] for
+// every i < offsets.size(); the shortest list drives the search
+bool HasPhrase(const std::vector<std::vector<uint32_t>>& term_positions, const std::vector<uint32_t>& offsets);
+
+// Tells if positions of the two sorted lists are at most max_distance apart
+bool HasProximity(const std::vector<uint32_t>& lhs, const std::vector<uint32_t>& rhs, uint32_t max_distance);
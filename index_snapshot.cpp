@@ -0,0 +1,110 @@
+#include "index_snapshot.h"
+
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+constexpr uint64_t SECTION_ALIGNMENT = 8;
+
+} // namespace
+
+IndexSnapshot::IndexSnapshot(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw system_error(errno, generic_category(), "Cannot open snapshot "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        const int error = errno;
+        close(fd);
+        throw system_error(error, generic_category(), "Cannot open snapshot "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ < sizeof(SnapshotHeader)) {
+        close(fd);
+        throw invalid_argument("File "s + path + " is not a snapshot"s);
+    }
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw system_error(errno, generic_category(), "Cannot map snapshot "s + path);
+    }
+    data_ = static_cast<const char*>(data);
+
+    const SnapshotHeader& header = GetHeader();
+    if (header.magic != SNAPSHOT_MAGIC) {
+        munmap(data, size_);
+        throw invalid_argument("File "s + path + " is not a snapshot"s);
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        munmap(data, size_);
+        throw invalid_argument("Unsupported snapshot version "s + to_string(header.version));
+    }
+}
+
+IndexSnapshot::~IndexSnapshot() {
+    munmap(const_cast<char*>(data_), size_);
+}
+
+shared_ptr<const IndexSnapshot> IndexSnapshot::Open(const string& path) {
+    return make_shared<const IndexSnapshot>(path);
+}
+
+const SnapshotHeader& IndexSnapshot::GetHeader() const {
+    return *reinterpret_cast<const SnapshotHeader*>(data_);
+}
+
+void IndexSnapshot::CheckSection(const SnapshotSection& section, size_t value_size) const {
+    if (section.offset % SECTION_ALIGNMENT != 0 || section.offset > size_
+        || section.size > (size_ - section.offset) / value_size) {
+        throw invalid_argument("Snapshot is corrupted"s);
+    }
+}
+
+SnapshotWriter::SnapshotWriter(const string& path)
+    : path_(path)
+    , out_(path, ios::binary | ios::trunc) {
+    if (!out_) {
+        throw system_error(errno, generic_category(), "Cannot create snapshot "s + path);
+    }
+    // The header is written last, when all sections are known
+    const SnapshotHeader header;
+    WriteBytes(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void SnapshotWriter::BeginSection() {
+    static constexpr char padding[SECTION_ALIGNMENT] = {};
+    WriteBytes(padding, (SECTION_ALIGNMENT - offset_ % SECTION_ALIGNMENT) % SECTION_ALIGNMENT);
+    section_offset_ = offset_;
+}
+
+SnapshotSection SnapshotWriter::EndSection(uint64_t count) {
+    return { section_offset_, count };
+}
+
+void SnapshotWriter::Finish(const SnapshotHeader& header) {
+    out_.seekp(0);
+    WriteBytes(reinterpret_cast<const char*>(&header), sizeof(header));
+    out_.close();
+    if (!out_) {
+        throw system_error(errno, generic_category(), "Cannot write snapshot "s + path_);
+    }
+}
+
+void SnapshotWriter::WriteBytes(const char* data, size_t size) {
+    out_.write(data, static_cast<streamsize>(size));
+    if (!out_) {
+        throw system_error(errno, generic_category(), "Cannot write snapshot "s + path_);
+    }
+    offset_ += size;
+}
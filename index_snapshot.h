@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Layout of a snapshot file written by SearchServer::SaveSnapshot. The file
+// starts with a SnapshotHeader, followed by sections: arrays of trivially
+// copyable values aligned to 8 bytes. Values are stored in the byte order of
+// the host that wrote the file.
+
+constexpr uint64_t SNAPSHOT_MAGIC = 0x50414E5348435253; // "SRCHSNAP"
+constexpr uint32_t SNAPSHOT_VERSION = 4;
+
+struct SnapshotSection {
+    // Byte offset from the start of the file
+    uint64_t offset = 0;
+    // Number of values
+    uint64_t size = 0;
+};
+
+// Entry of the posting_lists section, one per term id
+struct SnapshotPostingList {
+    // Index of the first posting in posting_document_ids and posting_term_freqs
+    uint64_t begin;
+    uint64_t size;
+    double max_term_freq;
+};
+
+// Entry of the forward_terms section: a term of a document with its term
+// frequency. SearchServer keeps its forward index in the same layout, so the
+// documents of a mapped snapshot are read in place
+struct TermFreq {
+    int32_t term_id;
+    double term_freq;
+};
+
+// Entry of the documents section, one per ordinal
+struct SnapshotDocument {
+    int32_t id;
+    int32_t rating;
+    int32_t status;
+    uint32_t word_count;
+    // Range of forward_terms, ordered by term id
+    uint64_t forward_begin;
+    uint64_t forward_size;
+};
+
+struct SnapshotHeader {
+    uint64_t magic = SNAPSHOT_MAGIC;
+    uint32_t version = SNAPSHOT_VERSION;
+    uint32_t reserved = 0;
+    // uint64_t offsets into stop_word_chars, one more than there are stop words
+    SnapshotSection stop_word_offsets;
+    SnapshotSection stop_word_chars;
+    // uint64_t offsets into term_chars, one more than there are terms
+    SnapshotSection term_offsets;
+    SnapshotSection term_chars;
+    // int32_t term ids in the order of their terms
+    SnapshotSection sorted_term_ids;
+    SnapshotSection posting_lists;
+    // int32_t document ordinals and double term frequencies
+    SnapshotSection posting_document_ids;
+    SnapshotSection posting_term_freqs;
+    SnapshotSection documents;
+    SnapshotSection forward_terms;
+    // uint64_t offsets into position_data, one more than there are documents if
+    // the index is positional and none otherwise
+    SnapshotSection position_offsets;
+    // DocumentPositions data of the documents
+    SnapshotSection position_data;
+};
+
+// Read-only memory mapping of a snapshot file.
+class IndexSnapshot {
+public:
+    // Throws invalid_argument if the file is not a snapshot of a supported version
+    // and system_error if it cannot be mapped
+    explicit IndexSnapshot(const std::string& path);
+    IndexSnapshot(const IndexSnapshot&) = delete;
+    IndexSnapshot& operator=(const IndexSnapshot&) = delete;
+    ~IndexSnapshot();
+
+    // Shared snapshot for the SearchServer constructor
+    static std::shared_ptr<const IndexSnapshot> Open(const std::string& path);
+
+    const SnapshotHeader& GetHeader() const;
+
+    // Throws invalid_argument if the section lies outside of the file
+    template <typename Value>
+    const Value* GetSection(const SnapshotSection& section) const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+
+    void CheckSection(const SnapshotSection& section, size_t value_size) const;
+};
+
+// Writes the sections of a snapshot file one after another.
+class SnapshotWriter {
+public:
+    // Throws system_error if the file cannot be created
+    explicit SnapshotWriter(const std::string& path);
+
+    // Starts a new section; every Write until EndSection appends to it
+    void BeginSection();
+    template <typename Value>
+    void Write(const Value* values, size_t count);
+    template <typename Value>
+    void Write(const std::vector<Value>& values);
+    // Returns the section of count values written since BeginSection
+    SnapshotSection EndSection(uint64_t count);
+
+    // Writes the header and closes the file
+    void Finish(const SnapshotHeader& header);
+
+private:
+    std::string path_;
+    std::ofstream out_;
+    uint64_t offset_ = 0;
+    uint64_t section_offset_ = 0;
+
+    void WriteBytes(const char* data, size_t size);
+};
+
+template <typename Value>
+const Value* IndexSnapshot::GetSection(const SnapshotSection& section) const {
+    CheckSection(section, sizeof(Value));
+    return reinterpret_cast<const Value*>(data_ + section.offset);
+}
+
+template <typename Value>
+void SnapshotWriter::Write(const Value* values, size_t count) {
+    WriteBytes(reinterpret_cast<const char*>(values), count * sizeof(Value));
+}
+
+template <typename Value>
+void SnapshotWriter::Write(const std::vector<Value>& values) {
+    Write(values.data(), values.size());
+}
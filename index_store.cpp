@@ -0,0 +1,113 @@
+#include "index_store.h"
+
+#include <cerrno>
+#include <filesystem>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const string CHECKPOINT_PREFIX = "checkpoint."s;
+const string TEMPORARY_SUFFIX = ".tmp"s;
+
+// Flushes a file or a directory entry list to the disk
+void SyncPath(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw system_error(errno, generic_category(), "Cannot open "s + path);
+    }
+    const int result = fsync(fd);
+    const int error = errno;
+    close(fd);
+    if (result != 0) {
+        throw system_error(error, generic_category(), "Cannot sync "s + path);
+    }
+}
+
+} // namespace
+
+IndexStore::IndexStore(string directory)
+    : directory_(move(directory)) {
+}
+
+unique_ptr<SearchServer> IndexStore::Open(string_view stop_words) {
+    filesystem::create_directories(directory_);
+    bool has_checkpoint = false;
+    for (const auto& entry : filesystem::directory_iterator(directory_)) {
+        const string name = entry.path().filename().string();
+        if (name.size() > TEMPORARY_SUFFIX.size() && name.compare(name.size() - TEMPORARY_SUFFIX.size(), TEMPORARY_SUFFIX.size(), TEMPORARY_SUFFIX) == 0) {
+            // Left by a checkpoint interrupted before it was renamed
+            filesystem::remove(entry.path());
+        }
+        else if (name.compare(0, CHECKPOINT_PREFIX.size(), CHECKPOINT_PREFIX) == 0) {
+            const uint64_t generation = stoull(name.substr(CHECKPOINT_PREFIX.size()));
+            if (!has_checkpoint || generation > generation_) {
+                generation_ = generation;
+                has_checkpoint = true;
+            }
+        }
+    }
+
+    if (!has_checkpoint) {
+        auto search_server = make_unique<SearchServer>(stop_words);
+        if (is_positional_) {
+            search_server->SetPositionalIndex(true);
+        }
+        Checkpoint(*search_server);
+        return search_server;
+    }
+    auto search_server = make_unique<SearchServer>(IndexSnapshot::Open(GetCheckpointPath(generation_)));
+    if (is_positional_) {
+        search_server->SetPositionalIndex(true);
+    }
+    WriteAheadLog::Replay(GetLogPath(generation_), *search_server);
+    log_ = make_shared<WriteAheadLog>(GetLogPath(generation_));
+    search_server->SetWriteAheadLog(log_);
+    return search_server;
+}
+
+void IndexStore::Checkpoint(SearchServer& search_server) {
+    const uint64_t generation = generation_ + 1;
+    const string checkpoint_path = GetCheckpointPath(generation);
+    search_server.SaveSnapshot(checkpoint_path + TEMPORARY_SUFFIX);
+    SyncPath(checkpoint_path + TEMPORARY_SUFFIX);
+    filesystem::rename(checkpoint_path + TEMPORARY_SUFFIX, checkpoint_path);
+    SyncPath(directory_);
+
+    // From here on recovery starts from the new checkpoint, with an empty log if
+    // log.<generation> is not created yet
+    log_ = make_shared<WriteAheadLog>(GetLogPath(generation));
+    search_server.SetWriteAheadLog(log_);
+    // A server loaded from the old checkpoint keeps its mapping after the file is removed
+    filesystem::remove(GetCheckpointPath(generation_));
+    filesystem::remove(GetLogPath(generation_));
+    generation_ = generation;
+}
+
+bool IndexStore::CheckpointIfNeeded(SearchServer& search_server) {
+    if (log_ && log_->GetSize() < max_log_size_) {
+        return false;
+    }
+    Checkpoint(search_server);
+    return true;
+}
+
+void IndexStore::SetMaxLogSize(uint64_t max_log_size) {
+    max_log_size_ = max_log_size;
+}
+
+void IndexStore::SetPositionalIndex(bool is_positional) {
+    is_positional_ = is_positional;
+}
+
+string IndexStore::GetCheckpointPath(uint64_t generation) const {
+    return (filesystem::path(directory_) / (CHECKPOINT_PREFIX + to_string(generation))).string();
+}
+
+string IndexStore::GetLogPath(uint64_t generation) const {
+    return (filesystem::path(directory_) / ("log."s + to_string(generation))).string();
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "search_server.h"
+#include "write_ahead_log.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Keeps a SearchServer recoverable in a directory of checkpoints and logs:
+// checkpoint.<N> is a snapshot of the whole index and log.<N> holds the
+// mutations made after it. Only the latest generation N is kept.
+class IndexStore {
+public:
+    explicit IndexStore(std::string directory);
+
+    // Loads the latest checkpoint, replays its log and attaches the log to the
+    // server. A new directory starts from an empty index with the stop words
+    std::unique_ptr<SearchServer> Open(std::string_view stop_words);
+
+    // Saves the server as the next checkpoint and switches it to an empty log.
+    // Must not run concurrently with additions or removals
+    void Checkpoint(SearchServer& search_server);
+    // Checkpoints once the log outgrows the maximum size, returns whether it did
+    bool CheckpointIfNeeded(SearchServer& search_server);
+    // 64 MB by default
+    void SetMaxLogSize(uint64_t max_log_size);
+    // Makes Open turn the positional index on before it replays the log, so a
+    // new directory keeps positions from the start. Checkpoints keep positions
+    // either way; Open throws invalid_argument if the checkpoint has documents
+    // without them. Off by default
+    void SetPositionalIndex(bool is_positional);
+
+private:
+    std::string directory_;
+    uint64_t generation_ = 0;
+    std::shared_ptr<WriteAheadLog> log_;
+    uint64_t max_log_size_ = 64 << 20;
+    bool is_positional_ = false;
+
+    std::string GetCheckpointPath(uint64_t generation) const;
+    std::string GetLogPath(uint64_t generation) const;
+};
@@ -0,0 +1,722 @@
+#include "inverted_index.h"
+#include "varint.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+using namespace std;
+
+PostingList::PostingList(PostingListEncoding encoding)
+    : encoding_(encoding) {
+}
+
+PostingList PostingList::FromMapped(const int* document_ids, const double* term_freqs, size_t size, double max_term_freq) {
+    PostingList postings(PostingListEncoding::PLAIN);
+    postings.mapped_document_ids_ = document_ids;
+    postings.mapped_term_freqs_ = term_freqs;
+    postings.size_ = size;
+    postings.max_term_freq_ = max_term_freq;
+    return postings;
+}
+
+void PostingList::Add(int document_id, double term_freq) {
+    Detach();
+    if (encoding_ == PostingListEncoding::PLAIN) {
+        if (document_ids_.empty() || document_ids_.back() < document_id) {
+            document_ids_.push_back(document_id);
+            term_freqs_.push_back(term_freq);
+            UpdateMaxTermFreq(term_freq);
+            ++size_;
+            return;
+        }
+        const auto it = lower_bound(document_ids_.begin(), document_ids_.end(), document_id);
+        const auto index = it - document_ids_.begin();
+        if (*it == document_id) {
+            term_freqs_[index] += term_freq;
+            UpdateMaxTermFreq(term_freqs_[index]);
+        }
+        else {
+            document_ids_.insert(it, document_id);
+            term_freqs_.insert(term_freqs_.begin() + index, term_freq);
+            UpdateMaxTermFreq(term_freq);
+            ++size_;
+        }
+        return;
+    }
+
+    if (blocks_.empty() || (blocks_.back().last_document_id < document_id && blocks_.back().size >= BLOCK_SIZE)) {
+        blocks_.push_back(EncodeBlock(&document_id, &term_freq, 1));
+        UpdateMaxTermFreq(term_freq);
+        ++size_;
+        return;
+    }
+    auto block = FindBlock(document_id);
+    if (block == blocks_.end()) {
+        block = prev(blocks_.end());
+    }
+    array<int, MAX_BLOCK_SIZE + 1> document_ids;
+    array<double, MAX_BLOCK_SIZE + 1> term_freqs;
+    DecodeBlock(*block, document_ids.data(), term_freqs.data());
+    size_t size = block->size;
+    const size_t index = lower_bound(document_ids.begin(), document_ids.begin() + size, document_id) - document_ids.begin();
+    if (index < size && document_ids[index] == document_id) {
+        term_freqs[index] += term_freq;
+    }
+    else {
+        copy_backward(document_ids.begin() + index, document_ids.begin() + size, document_ids.begin() + size + 1);
+        copy_backward(term_freqs.begin() + index, term_freqs.begin() + size, term_freqs.begin() + size + 1);
+        document_ids[index] = document_id;
+        term_freqs[index] = term_freq;
+        ++size;
+        ++size_;
+    }
+    UpdateMaxTermFreq(term_freqs[index]);
+    ReplaceBlock(block, document_ids.data(), term_freqs.data(), size);
+}
+
+void PostingList::Append(const vector<pair<int, double>>& postings) {
+    if (postings.empty()) {
+        return;
+    }
+    Detach();
+    const bool is_ordered = encoding_ == PostingListEncoding::PLAIN
+        ? document_ids_.empty() || document_ids_.back() < postings.front().first
+        : blocks_.empty() || blocks_.back().last_document_id < postings.front().first;
+    if (!is_ordered) {
+        for (const auto& [document_id, term_freq] : postings) {
+            Add(document_id, term_freq);
+        }
+        return;
+    }
+
+    for (const auto& [document_id, term_freq] : postings) {
+        UpdateMaxTermFreq(term_freq);
+    }
+    size_ += postings.size();
+    if (encoding_ == PostingListEncoding::PLAIN) {
+        document_ids_.reserve(document_ids_.size() + postings.size());
+        term_freqs_.reserve(term_freqs_.size() + postings.size());
+        for (const auto& [document_id, term_freq] : postings) {
+            document_ids_.push_back(document_id);
+            term_freqs_.push_back(term_freq);
+        }
+        return;
+    }
+
+    // Fills up the last block, then encodes full blocks
+    array<int, BLOCK_SIZE> document_ids;
+    array<double, BLOCK_SIZE> term_freqs;
+    size_t size = 0;
+    if (!blocks_.empty() && blocks_.back().size < BLOCK_SIZE) {
+        size = blocks_.back().size;
+        DecodeBlock(blocks_.back(), document_ids.data(), term_freqs.data());
+        blocks_.pop_back();
+    }
+    for (const auto& [document_id, term_freq] : postings) {
+        document_ids[size] = document_id;
+        term_freqs[size] = term_freq;
+        if (++size == BLOCK_SIZE) {
+            blocks_.push_back(EncodeBlock(document_ids.data(), term_freqs.data(), size));
+            size = 0;
+        }
+    }
+    if (size > 0) {
+        blocks_.push_back(EncodeBlock(document_ids.data(), term_freqs.data(), size));
+    }
+}
+
+bool PostingList::Erase(int document_id) {
+    Detach();
+    if (encoding_ == PostingListEncoding::PLAIN) {
+        const auto it = lower_bound(document_ids_.begin(), document_ids_.end(), document_id);
+        if (it == document_ids_.end() || *it != document_id) {
+            return false;
+        }
+        term_freqs_.erase(term_freqs_.begin() + (it - document_ids_.begin()));
+        document_ids_.erase(it);
+        --size_;
+        return true;
+    }
+
+    const auto block = FindBlock(document_id);
+    if (block == blocks_.end() || !BlockContains(*block, document_id)) {
+        return false;
+    }
+    array<int, MAX_BLOCK_SIZE> document_ids;
+    array<double, MAX_BLOCK_SIZE> term_freqs;
+    DecodeBlock(*block, document_ids.data(), term_freqs.data());
+    const size_t size = block->size;
+    const size_t index = lower_bound(document_ids.begin(), document_ids.begin() + size, document_id) - document_ids.begin();
+    copy(document_ids.begin() + index + 1, document_ids.begin() + size, document_ids.begin() + index);
+    copy(term_freqs.begin() + index + 1, term_freqs.begin() + size, term_freqs.begin() + index);
+    --size_;
+    if (size == 1) {
+        blocks_.erase(block);
+    }
+    else {
+        ReplaceBlock(block, document_ids.data(), term_freqs.data(), size - 1);
+    }
+    return true;
+}
+
+size_t PostingList::Erase(const vector<int>& document_ids) {
+    Detach();
+    const size_t old_size = size_;
+    auto erased = document_ids.begin();
+    if (encoding_ == PostingListEncoding::PLAIN) {
+        size_t kept = 0;
+        for (size_t i = 0; i < document_ids_.size(); ++i) {
+            erased = lower_bound(erased, document_ids.end(), document_ids_[i]);
+            if (erased != document_ids.end() && *erased == document_ids_[i]) {
+                continue;
+            }
+            document_ids_[kept] = document_ids_[i];
+            term_freqs_[kept] = term_freqs_[i];
+            ++kept;
+        }
+        document_ids_.resize(kept);
+        term_freqs_.resize(kept);
+        size_ = kept;
+        return old_size - size_;
+    }
+
+    vector<Block> blocks;
+    blocks.reserve(blocks_.size());
+    array<int, MAX_BLOCK_SIZE> block_document_ids;
+    array<double, MAX_BLOCK_SIZE> block_term_freqs;
+    for (Block& block : blocks_) {
+        erased = lower_bound(erased, document_ids.end(), block.first_document_id);
+        if (erased == document_ids.end() || *erased > block.last_document_id) {
+            blocks.push_back(move(block));
+            continue;
+        }
+        DecodeBlock(block, block_document_ids.data(), block_term_freqs.data());
+        size_t kept = 0;
+        for (size_t i = 0; i < block.size; ++i) {
+            erased = lower_bound(erased, document_ids.end(), block_document_ids[i]);
+            if (erased != document_ids.end() && *erased == block_document_ids[i]) {
+                continue;
+            }
+            block_document_ids[kept] = block_document_ids[i];
+            block_term_freqs[kept] = block_term_freqs[i];
+            ++kept;
+        }
+        size_ -= block.size - kept;
+        if (kept > 0) {
+            blocks.push_back(EncodeBlock(block_document_ids.data(), block_term_freqs.data(), kept));
+        }
+    }
+    blocks_ = move(blocks);
+    return old_size - size_;
+}
+
+bool PostingList::Contains(int document_id) const {
+    if (encoding_ == PostingListEncoding::PLAIN) {
+        return binary_search(GetPlainDocumentIds(), GetPlainDocumentIds() + size_, document_id);
+    }
+    const auto block = lower_bound(blocks_.begin(), blocks_.end(), document_id,
+        [](const Block& block, int id) {
+            return block.last_document_id < id;
+        });
+    return block != blocks_.end() && BlockContains(*block, document_id);
+}
+
+double PostingList::FindTermFreq(int document_id) const {
+    if (encoding_ == PostingListEncoding::PLAIN) {
+        const int* document_ids = GetPlainDocumentIds();
+        const int* it = lower_bound(document_ids, document_ids + size_, document_id);
+        return it != document_ids + size_ && *it == document_id ? GetPlainTermFreqs()[it - document_ids] : 0.0;
+    }
+    const auto block = lower_bound(blocks_.begin(), blocks_.end(), document_id,
+        [](const Block& block, int id) {
+            return block.last_document_id < id;
+        });
+    if (block == blocks_.end() || document_id < block->first_document_id) {
+        return 0.0;
+    }
+    // Frequencies follow all the id gaps
+    const uint8_t* in = block->data.data();
+    int current = block->first_document_id;
+    size_t index = current == document_id ? 0 : block->size;
+    for (size_t i = 1; i < block->size; ++i) {
+        current += static_cast<int>(ReadVarint(in));
+        if (current == document_id) {
+            index = i;
+        }
+    }
+    if (index == block->size) {
+        return 0.0;
+    }
+    float term_freq;
+    memcpy(&term_freq, in + index * sizeof(float), sizeof(float));
+    return term_freq;
+}
+
+size_t PostingList::Size() const {
+    return size_;
+}
+
+bool PostingList::Empty() const {
+    return size_ == 0;
+}
+
+double PostingList::GetMaxTermFreq() const {
+    return max_term_freq_;
+}
+
+PostingListEncoding PostingList::GetEncoding() const {
+    return encoding_;
+}
+
+void PostingList::ShrinkToFit() {
+    document_ids_.shrink_to_fit();
+    term_freqs_.shrink_to_fit();
+    blocks_.shrink_to_fit();
+}
+
+void PostingList::SetEncoding(PostingListEncoding encoding) {
+    if (encoding == encoding_) {
+        return;
+    }
+    const bool has_impact_order = !impacts_.empty();
+    Detach();
+    if (encoding == PostingListEncoding::COMPRESSED) {
+        for (size_t begin = 0; begin < size_; begin += BLOCK_SIZE) {
+            blocks_.push_back(EncodeBlock(document_ids_.data() + begin, term_freqs_.data() + begin, min(BLOCK_SIZE, size_ - begin)));
+        }
+        vector<int>().swap(document_ids_);
+        vector<double>().swap(term_freqs_);
+        // Compressed frequencies are rounded to float and may round up
+        max_term_freq_ = static_cast<float>(max_term_freq_);
+    }
+    else {
+        document_ids_.resize(size_);
+        term_freqs_.resize(size_);
+        size_t offset = 0;
+        for (const Block& block : blocks_) {
+            DecodeBlock(block, document_ids_.data() + offset, term_freqs_.data() + offset);
+            offset += block.size;
+        }
+        vector<Block>().swap(blocks_);
+    }
+    encoding_ = encoding;
+    // Compressed frequencies are rounded, which the impacts must match
+    if (has_impact_order) {
+        BuildImpactOrder();
+    }
+}
+
+void PostingList::BuildImpactOrder() {
+    impacts_.clear();
+    impacts_.reserve(size_);
+    ForEach([this](int document_id, double term_freq) {
+        impacts_.push_back({ document_id, term_freq });
+    });
+    stable_sort(impacts_.begin(), impacts_.end(), [](const Impact& lhs, const Impact& rhs) {
+        return lhs.term_freq > rhs.term_freq;
+    });
+}
+
+void PostingList::ClearImpactOrder() {
+    vector<Impact>().swap(impacts_);
+}
+
+const vector<PostingList::Impact>& PostingList::GetImpacts() const {
+    return impacts_;
+}
+
+PostingList::Block PostingList::EncodeBlock(const int* document_ids, const double* term_freqs, size_t size) {
+    Block block;
+    block.first_document_id = document_ids[0];
+    block.last_document_id = document_ids[size - 1];
+    block.size = static_cast<uint32_t>(size);
+    for (size_t i = 1; i < size; ++i) {
+        WriteVarint(block.data, static_cast<uint32_t>(document_ids[i] - document_ids[i - 1]));
+    }
+    const size_t ids_size = block.data.size();
+    block.data.resize(ids_size + size * sizeof(float));
+    for (size_t i = 0; i < size; ++i) {
+        const float term_freq = static_cast<float>(term_freqs[i]);
+        memcpy(block.data.data() + ids_size + i * sizeof(float), &term_freq, sizeof(float));
+    }
+    block.data.shrink_to_fit();
+    return block;
+}
+
+void PostingList::DecodeBlock(const Block& block, int* document_ids, double* term_freqs) {
+    const uint8_t* in = block.data.data();
+    document_ids[0] = block.first_document_id;
+    for (size_t i = 1; i < block.size; ++i) {
+        document_ids[i] = document_ids[i - 1] + static_cast<int>(ReadVarint(in));
+    }
+    for (size_t i = 0; i < block.size; ++i, in += sizeof(float)) {
+        float term_freq;
+        memcpy(&term_freq, in, sizeof(float));
+        term_freqs[i] = term_freq;
+    }
+}
+
+bool PostingList::BlockContains(const Block& block, int document_id) {
+    if (document_id < block.first_document_id || document_id > block.last_document_id) {
+        return false;
+    }
+    const uint8_t* in = block.data.data();
+    int current = block.first_document_id;
+    for (size_t i = 1; i < block.size && current < document_id; ++i) {
+        current += static_cast<int>(ReadVarint(in));
+    }
+    return current == document_id;
+}
+
+const int* PostingList::GetPlainDocumentIds() const {
+    return mapped_document_ids_ != nullptr ? mapped_document_ids_ : document_ids_.data();
+}
+
+const double* PostingList::GetPlainTermFreqs() const {
+    return mapped_term_freqs_ != nullptr ? mapped_term_freqs_ : term_freqs_.data();
+}
+
+void PostingList::Detach() {
+    impacts_.clear();
+    if (mapped_document_ids_ == nullptr) {
+        return;
+    }
+    document_ids_.assign(mapped_document_ids_, mapped_document_ids_ + size_);
+    term_freqs_.assign(mapped_term_freqs_, mapped_term_freqs_ + size_);
+    mapped_document_ids_ = nullptr;
+    mapped_term_freqs_ = nullptr;
+}
+
+vector<PostingList::Block>::iterator PostingList::FindBlock(int document_id) {
+    return lower_bound(blocks_.begin(), blocks_.end(), document_id,
+        [](const Block& block, int id) {
+            return block.last_document_id < id;
+        });
+}
+
+void PostingList::ReplaceBlock(vector<Block>::iterator block, const int* document_ids, const double* term_freqs, size_t size) {
+    if (size <= MAX_BLOCK_SIZE) {
+        *block = EncodeBlock(document_ids, term_freqs, size);
+        return;
+    }
+    const size_t half = size / 2;
+    *block = EncodeBlock(document_ids, term_freqs, half);
+    blocks_.insert(next(block), EncodeBlock(document_ids + half, term_freqs + half, size - half));
+}
+
+void PostingList::UpdateMaxTermFreq(double term_freq) {
+    if (encoding_ == PostingListEncoding::COMPRESSED) {
+        term_freq = static_cast<float>(term_freq);
+    }
+    max_term_freq_ = max(max_term_freq_, term_freq);
+}
+
+PostingList::Cursor::Cursor(const PostingList& postings)
+    : postings_(&postings)
+    , is_plain_(postings.encoding_ == PostingListEncoding::PLAIN) {
+    if (is_plain_) {
+        size_ = postings.size_;
+        plain_document_ids_ = postings.GetPlainDocumentIds();
+        plain_term_freqs_ = postings.GetPlainTermFreqs();
+    }
+    else {
+        LoadBlock(0);
+    }
+}
+
+void PostingList::Cursor::SkipTo(int document_id) {
+    if (AtEnd() || GetDocumentId() >= document_id) {
+        return;
+    }
+    if (is_plain_) {
+        index_ = lower_bound(plain_document_ids_ + index_, plain_document_ids_ + size_, document_id) - plain_document_ids_;
+        return;
+    }
+    const auto& blocks = postings_->blocks_;
+    if (blocks[block_].last_document_id < document_id) {
+        const auto block = lower_bound(blocks.begin() + block_ + 1, blocks.end(), document_id,
+            [](const Block& block, int id) {
+                return block.last_document_id < id;
+            });
+        LoadBlock(block - blocks.begin());
+        if (AtEnd()) {
+            return;
+        }
+    }
+    index_ = lower_bound(block_document_ids_.begin() + index_, block_document_ids_.begin() + size_, document_id)
+        - block_document_ids_.begin();
+}
+
+void PostingList::Cursor::LoadBlock(size_t block) {
+    block_ = block;
+    index_ = 0;
+    size_ = 0;
+    if (block < postings_->blocks_.size()) {
+        DecodeBlock(postings_->blocks_[block], block_document_ids_.data(), block_term_freqs_.data());
+        size_ = postings_->blocks_[block].size;
+    }
+}
+
+IndexSegment::IndexSegment(int begin, PostingListEncoding encoding)
+    : begin_(begin)
+    , end_(begin)
+    , encoding_(encoding) {
+}
+
+int IndexSegment::GetBegin() const {
+    return begin_;
+}
+
+int IndexSegment::GetEnd() const {
+    return end_;
+}
+
+size_t IndexSegment::GetDocumentCount() const {
+    return document_count_;
+}
+
+const PostingList* IndexSegment::Find(int term_id) const {
+    const auto it = postings_.find(term_id);
+    if (it == postings_.end() || it->second.Empty()) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+IndexSegment IndexSegment::Merge(const vector<shared_ptr<const IndexSegment>>& segments, const vector<bool>& is_removed, PostingListEncoding encoding, bool has_impact_order) {
+    IndexSegment merged(segments.front()->begin_, encoding);
+    merged.end_ = segments.back()->end_;
+    vector<int> term_ids;
+    for (const auto& segment : segments) {
+        for (const auto& [term_id, postings] : segment->postings_) {
+            term_ids.push_back(term_id);
+        }
+        merged.document_count_ += segment->document_count_;
+    }
+    merged.document_count_ -= count(is_removed.begin(), is_removed.end(), true);
+    sort(term_ids.begin(), term_ids.end());
+    term_ids.erase(unique(term_ids.begin(), term_ids.end()), term_ids.end());
+
+    merged.postings_.reserve(term_ids.size());
+    vector<pair<int, double>> postings;
+    for (const int term_id : term_ids) {
+        postings.clear();
+        for (const auto& segment : segments) {
+            if (const PostingList* segment_postings = segment->Find(term_id)) {
+                segment_postings->ForEach([&](int ordinal, double term_freq) {
+                    if (!is_removed[ordinal - merged.begin_]) {
+                        postings.emplace_back(ordinal, term_freq);
+                    }
+                });
+            }
+        }
+        if (!postings.empty()) {
+            PostingList& merged_postings = merged.postings_.emplace(term_id, PostingList(encoding)).first->second;
+            merged_postings.Append(postings);
+            if (has_impact_order) {
+                merged_postings.BuildImpactOrder();
+            }
+        }
+    }
+    return merged;
+}
+
+PostingList& IndexSegment::GetPostings(int term_id) {
+    return postings_.try_emplace(term_id, encoding_).first->second;
+}
+
+InvertedIndex::InvertedIndex(PostingListEncoding encoding)
+    : encoding_(encoding) {
+    segments_.push_back(make_shared<IndexSegment>(0, encoding));
+    removed_counts_.push_back(0);
+}
+
+InvertedIndex::InvertedIndex(const InvertedIndex& other)
+    : encoding_(other.encoding_)
+    , has_impact_order_(other.has_impact_order_)
+    , terms_(other.terms_)
+    , document_freqs_(other.document_freqs_)
+    , segments_(other.segments_)
+    , removed_counts_(other.removed_counts_) {
+    segments_.back() = make_shared<IndexSegment>(*other.segments_.back());
+}
+
+int InvertedIndex::AddTerm(string_view word) {
+    const int term_id = terms_.Add(word);
+    if (static_cast<size_t>(term_id) == document_freqs_.size()) {
+        document_freqs_.push_back(0);
+    }
+    return term_id;
+}
+
+void InvertedIndex::SetMappedTerms(const uint64_t* offsets, const char* chars, const int32_t* sorted_term_ids, size_t count) {
+    terms_.SetMappedTerms(offsets, chars, sorted_term_ids, count);
+    document_freqs_.assign(count, 0);
+}
+
+const TermDictionary& InvertedIndex::GetTerms() const {
+    return terms_;
+}
+
+int InvertedIndex::FindTerm(string_view word) const {
+    const int term_id = terms_.Find(word);
+    if (term_id == TermDictionary::NO_TERM || document_freqs_[term_id] == 0) {
+        return TermDictionary::NO_TERM;
+    }
+    return term_id;
+}
+
+size_t InvertedIndex::GetDocumentFreq(int term_id) const {
+    return document_freqs_[term_id];
+}
+
+size_t InvertedIndex::GetSegmentCount() const {
+    return segments_.size();
+}
+
+const IndexSegment& InvertedIndex::GetSegment(size_t index) const {
+    return *segments_[index];
+}
+
+shared_ptr<IndexSegment> InvertedIndex::ShareSegment(size_t index) const {
+    return segments_[index];
+}
+
+size_t InvertedIndex::GetRemovedCount(size_t index) const {
+    return removed_counts_[index];
+}
+
+bool InvertedIndex::IsSealed(int ordinal) const {
+    return ordinal < segments_.back()->begin_;
+}
+
+void InvertedIndex::Add(int term_id, int ordinal, double term_freq) {
+    PostingList& postings = GetMutableSegment().GetPostings(term_id);
+    const size_t size = postings.Size();
+    postings.Add(ordinal, term_freq);
+    document_freqs_[term_id] += postings.Size() - size;
+}
+
+void InvertedIndex::PrepareAppend(int term_id) {
+    GetMutableSegment().GetPostings(term_id);
+}
+
+void InvertedIndex::Append(int term_id, const vector<pair<int, double>>& postings) {
+    GetMutableSegment().postings_.find(term_id)->second.Append(postings);
+    document_freqs_[term_id] += postings.size();
+}
+
+void InvertedIndex::SetPostings(int term_id, PostingList postings) {
+    document_freqs_[term_id] += postings.Size();
+    GetMutableSegment().GetPostings(term_id) = move(postings);
+}
+
+void InvertedIndex::AddDocument(int ordinal) {
+    IndexSegment& segment = GetMutableSegment();
+    segment.end_ = max(segment.end_, ordinal + 1);
+    ++segment.document_count_;
+}
+
+void InvertedIndex::Erase(int term_id, int ordinal) {
+    if (GetMutableSegment().postings_.find(term_id)->second.Erase(ordinal)) {
+        --document_freqs_[term_id];
+    }
+}
+
+void InvertedIndex::Erase(int term_id, const vector<int>& ordinals) {
+    document_freqs_[term_id] -= GetMutableSegment().postings_.find(term_id)->second.Erase(ordinals);
+}
+
+void InvertedIndex::EraseDocument() {
+    --GetMutableSegment().document_count_;
+}
+
+void InvertedIndex::MarkRemoved(int term_id) {
+    --document_freqs_[term_id];
+}
+
+void InvertedIndex::MarkDocumentRemoved(int ordinal) {
+    ++removed_counts_[FindSegment(ordinal)];
+}
+
+void InvertedIndex::SealMutableSegment(int end) {
+    IndexSegment& segment = GetMutableSegment();
+    segment.end_ = max(segment.end_, end);
+    for (auto& [term_id, postings] : segment.postings_) {
+        postings.ShrinkToFit();
+        if (has_impact_order_) {
+            postings.BuildImpactOrder();
+        }
+    }
+    segments_.push_back(make_shared<IndexSegment>(segment.end_, encoding_));
+    removed_counts_.push_back(0);
+}
+
+void InvertedIndex::ReplaceSegments(size_t first, size_t count, shared_ptr<IndexSegment> merged, size_t purged_count) {
+    const auto removed_begin = removed_counts_.begin() + first;
+    *removed_begin = accumulate(removed_begin, removed_begin + count, size_t{ 0 }) - purged_count;
+    removed_counts_.erase(removed_begin + 1, removed_begin + count);
+    const auto begin = segments_.begin() + first;
+    *begin = move(merged);
+    segments_.erase(begin + 1, begin + count);
+}
+
+void InvertedIndex::ShareSegments(const InvertedIndex& other) {
+    for (size_t i = 0; i + 1 < segments_.size() && i + 1 < other.segments_.size(); ++i) {
+        if (segments_[i]->begin_ == other.segments_[i]->begin_ && segments_[i]->end_ == other.segments_[i]->end_) {
+            segments_[i] = other.segments_[i];
+        }
+    }
+}
+
+PostingListEncoding InvertedIndex::GetEncoding() const {
+    return encoding_;
+}
+
+void InvertedIndex::SetEncoding(PostingListEncoding encoding) {
+    encoding_ = encoding;
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        if (i + 1 < segments_.size()) {
+            segments_[i] = make_shared<IndexSegment>(*segments_[i]);
+        }
+        segments_[i]->encoding_ = encoding;
+        for (auto& [term_id, postings] : segments_[i]->postings_) {
+            postings.SetEncoding(encoding);
+        }
+    }
+}
+
+bool InvertedIndex::HasImpactOrder() const {
+    return has_impact_order_;
+}
+
+void InvertedIndex::SetImpactOrder(bool has_impact_order) {
+    if (has_impact_order == has_impact_order_) {
+        return;
+    }
+    has_impact_order_ = has_impact_order;
+    for (size_t i = 0; i + 1 < segments_.size(); ++i) {
+        segments_[i] = make_shared<IndexSegment>(*segments_[i]);
+        for (auto& [term_id, postings] : segments_[i]->postings_) {
+            if (has_impact_order) {
+                postings.BuildImpactOrder();
+            }
+            else {
+                postings.ClearImpactOrder();
+            }
+        }
+    }
+}
+
+IndexSegment& InvertedIndex::GetMutableSegment() {
+    return *segments_.back();
+}
+
+size_t InvertedIndex::FindSegment(int ordinal) const {
+    const auto it = upper_bound(segments_.begin(), segments_.end(), ordinal,
+        [](int ordinal, const shared_ptr<IndexSegment>& segment) {
+            return ordinal < segment->begin_;
+        });
+    return it - segments_.begin() - 1;
+}
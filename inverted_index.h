@@ -0,0 +1,298 @@
+#pragma once
+
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum class PostingListEncoding {
+    // Document ids and double term frequencies in two parallel arrays
+    PLAIN,
+    // Blocks of delta + varint encoded document ids with float term
+    // frequencies; the first/last id of every block serve as skip pointers
+    COMPRESSED,
+};
+
+// Postings of one word ordered by document id.
+class PostingList {
+public:
+    static constexpr size_t BLOCK_SIZE = 128;
+    static constexpr size_t MAX_BLOCK_SIZE = 2 * BLOCK_SIZE;
+
+    class Cursor;
+
+    // Posting of the impact order
+    struct Impact {
+        int document_id;
+        double term_freq;
+    };
+
+    explicit PostingList(PostingListEncoding encoding = PostingListEncoding::PLAIN);
+    // Plain list reading sorted postings from memory it does not own, which must
+    // outlive it; the postings are copied on the first modification
+    static PostingList FromMapped(const int* document_ids, const double* term_freqs, size_t size, double max_term_freq);
+
+    void Add(int document_id, double term_freq);
+    // Takes postings ordered by document id; ids above all present ones are
+    // appended without searching the list
+    void Append(const std::vector<std::pair<int, double>>& postings);
+    bool Erase(int document_id);
+    // Erases postings of sorted document ids in one pass, returns the number of erased postings
+    size_t Erase(const std::vector<int>& document_ids);
+    bool Contains(int document_id) const;
+    // Returns 0 if the document has no posting
+    double FindTermFreq(int document_id) const;
+
+    size_t Size() const;
+    bool Empty() const;
+
+    // Upper bound of the term frequencies in the list; may stay above the
+    // actual maximum after erasures
+    double GetMaxTermFreq() const;
+
+    PostingListEncoding GetEncoding() const;
+    void SetEncoding(PostingListEncoding encoding);
+    // Releases spare capacity
+    void ShrinkToFit();
+
+    // Keeps a copy of the postings ordered by decreasing term frequency, which
+    // orders them by score as well; modifications drop it, re-encoding rebuilds it
+    void BuildImpactOrder();
+    void ClearImpactOrder();
+    // Empty unless built
+    const std::vector<Impact>& GetImpacts() const;
+
+    // Calls function(document_id, term_freq) in ascending document id order
+    template <typename Function>
+    void ForEach(Function function) const;
+
+private:
+    struct Block {
+        int first_document_id = 0;
+        int last_document_id = 0;
+        uint32_t size = 0;
+        // Varint gaps of document ids after the first one, then size floats
+        std::vector<uint8_t> data;
+    };
+
+    PostingListEncoding encoding_;
+    size_t size_ = 0;
+    double max_term_freq_ = 0.0;
+
+    std::vector<int> document_ids_;
+    std::vector<double> term_freqs_;
+    // Replace the two vectors in a list created by FromMapped until it is detached
+    const int* mapped_document_ids_ = nullptr;
+    const double* mapped_term_freqs_ = nullptr;
+
+    std::vector<Block> blocks_;
+
+    std::vector<Impact> impacts_;
+
+    static Block EncodeBlock(const int* document_ids, const double* term_freqs, size_t size);
+    static void DecodeBlock(const Block& block, int* document_ids, double* term_freqs);
+    static bool BlockContains(const Block& block, int document_id);
+
+    const int* GetPlainDocumentIds() const;
+    const double* GetPlainTermFreqs() const;
+    // Copies mapped postings into the vectors and drops the impact order before a modification
+    void Detach();
+
+    std::vector<Block>::iterator FindBlock(int document_id);
+    void ReplaceBlock(std::vector<Block>::iterator block, const int* document_ids, const double* term_freqs, size_t size);
+    void UpdateMaxTermFreq(double term_freq);
+};
+
+// Forward iterator over a posting list supporting skips to a document id.
+class PostingList::Cursor {
+public:
+    explicit Cursor(const PostingList& postings);
+
+    bool AtEnd() const;
+    int GetDocumentId() const;
+    double GetTermFreq() const;
+
+    void Next();
+    // Moves to the first posting with document id not less than document_id
+    void SkipTo(int document_id);
+
+private:
+    const PostingList* postings_;
+    bool is_plain_;
+    const int* plain_document_ids_ = nullptr;
+    const double* plain_term_freqs_ = nullptr;
+    // Position in the plain arrays or in the decoded block
+    size_t index_ = 0;
+    size_t size_ = 0;
+
+    size_t block_ = 0;
+    std::array<int, MAX_BLOCK_SIZE> block_document_ids_;
+    std::array<double, MAX_BLOCK_SIZE> block_term_freqs_;
+
+    void LoadBlock(size_t block);
+};
+
+// Posting lists of the documents with ordinals in [begin, end), addressed
+// by term id. Only the mutable segment of an InvertedIndex is modified;
+// sealed segments never change, so indexes may share them, and documents
+// removed from them stay there until a merge.
+class IndexSegment {
+public:
+    IndexSegment(int begin, PostingListEncoding encoding);
+
+    int GetBegin() const;
+    int GetEnd() const;
+    // Documents having postings in the segment, including removed ones
+    size_t GetDocumentCount() const;
+
+    // Returns nullptr if the segment has no postings of the term
+    const PostingList* Find(int term_id) const;
+
+    // Concatenates adjacent segments leaving out the postings of documents
+    // marked in is_removed, which is indexed by ordinal - segments[0]->GetBegin()
+    static IndexSegment Merge(const std::vector<std::shared_ptr<const IndexSegment>>& segments,
+        const std::vector<bool>& is_removed, PostingListEncoding encoding, bool has_impact_order);
+
+private:
+    friend class InvertedIndex;
+
+    int begin_;
+    int end_;
+    size_t document_count_ = 0;
+    PostingListEncoding encoding_;
+    // Only terms having postings in the segment
+    std::unordered_map<int, PostingList> postings_;
+
+    PostingList& GetPostings(int term_id);
+};
+
+// Term dictionary and posting lists split into segments of consecutive
+// ordinals: sealed segments followed by one mutable segment that receives
+// new documents. Document frequencies are kept per term over all segments.
+class InvertedIndex {
+public:
+    explicit InvertedIndex(PostingListEncoding encoding = PostingListEncoding::PLAIN);
+    // Shares the sealed segments and copies the rest
+    InvertedIndex(const InvertedIndex& other);
+    InvertedIndex& operator=(const InvertedIndex&) = delete;
+
+    // Returns the id of the word, adding it to the dictionary if needed
+    int AddTerm(std::string_view word);
+    // Takes the first terms from mapped tables, see TermDictionary::SetMappedTerms;
+    // the index must have no terms
+    void SetMappedTerms(const uint64_t* offsets, const char* chars, const int32_t* sorted_term_ids, size_t count);
+    const TermDictionary& GetTerms() const;
+    // Returns TermDictionary::NO_TERM if no document that is not removed has the word
+    int FindTerm(std::string_view word) const;
+    // Number of documents having the term that are not removed
+    size_t GetDocumentFreq(int term_id) const;
+
+    // Segments in ordinal order, the last one is mutable
+    size_t GetSegmentCount() const;
+    const IndexSegment& GetSegment(size_t index) const;
+    std::shared_ptr<IndexSegment> ShareSegment(size_t index) const;
+    // Removed documents whose postings are still in the segment
+    size_t GetRemovedCount(size_t index) const;
+    bool IsSealed(int ordinal) const;
+
+    // Modify the mutable segment: ordinals are not less than its begin, and
+    // every document is added with all its terms before the next one
+    void Add(int term_id, int ordinal, double term_freq);
+    // Creates the posting list of the term in the mutable segment, after which
+    // postings of distinct prepared terms may be appended concurrently
+    void PrepareAppend(int term_id);
+    // Takes postings ordered by ordinal
+    void Append(int term_id, const std::vector<std::pair<int, double>>& postings);
+    // Replaces the postings of a term without postings
+    void SetPostings(int term_id, PostingList postings);
+    // Extends the mutable segment to the ordinal
+    void AddDocument(int ordinal);
+    // Erase takes terms of documents in the mutable segment, so their posting
+    // lists exist and only they are changed; distinct terms may be erased concurrently
+    void Erase(int term_id, int ordinal);
+    // Takes sorted ordinals
+    void Erase(int term_id, const std::vector<int>& ordinals);
+    // Counts the document as erased from the mutable segment
+    void EraseDocument();
+
+    // Excludes a removed document from document frequencies, leaving its postings
+    // until its segment is merged
+    void MarkRemoved(int term_id);
+    void MarkDocumentRemoved(int ordinal);
+
+    // Seals the mutable segment at ordinal end and starts a new mutable segment there
+    void SealMutableSegment(int end);
+    // Replaces sealed segments [first, first + count) with their merge, which left
+    // out purged_count removed documents
+    void ReplaceSegments(size_t first, size_t count, std::shared_ptr<IndexSegment> merged, size_t purged_count);
+    // Takes over the sealed segments of an index that underwent the same modifications
+    void ShareSegments(const InvertedIndex& other);
+
+    PostingListEncoding GetEncoding() const;
+    // Re-encodes all existing posting lists, sealed segments into new copies;
+    // new lists are created with the same encoding
+    void SetEncoding(PostingListEncoding encoding);
+
+    bool HasImpactOrder() const;
+    // Builds or drops the impact order of the posting lists of sealed segments,
+    // which are replaced by new copies; segments sealed later follow the setting
+    void SetImpactOrder(bool has_impact_order);
+
+private:
+    PostingListEncoding encoding_;
+    bool has_impact_order_ = false;
+    TermDictionary terms_;
+    // Indexed by term id
+    std::vector<size_t> document_freqs_;
+    std::vector<std::shared_ptr<IndexSegment>> segments_;
+    // Indexed like segments_
+    std::vector<size_t> removed_counts_;
+
+    IndexSegment& GetMutableSegment();
+    size_t FindSegment(int ordinal) const;
+};
+
+template <typename Function>
+void PostingList::ForEach(Function function) const {
+    if (encoding_ == PostingListEncoding::PLAIN) {
+        const int* document_ids = GetPlainDocumentIds();
+        const double* term_freqs = GetPlainTermFreqs();
+        for (size_t i = 0; i < size_; ++i) {
+            function(document_ids[i], term_freqs[i]);
+        }
+        return;
+    }
+    std::array<int, MAX_BLOCK_SIZE> document_ids;
+    std::array<double, MAX_BLOCK_SIZE> term_freqs;
+    for (const Block& block : blocks_) {
+        DecodeBlock(block, document_ids.data(), term_freqs.data());
+        for (size_t i = 0; i < block.size; ++i) {
+            function(document_ids[i], term_freqs[i]);
+        }
+    }
+}
+
+inline bool PostingList::Cursor::AtEnd() const {
+    return is_plain_ ? index_ == size_ : block_ == postings_->blocks_.size();
+}
+
+inline int PostingList::Cursor::GetDocumentId() const {
+    return is_plain_ ? plain_document_ids_[index_] : block_document_ids_[index_];
+}
+
+inline double PostingList::Cursor::GetTermFreq() const {
+    return is_plain_ ? plain_term_freqs_[index_] : block_term_freqs_[index_];
+}
+
+inline void PostingList::Cursor::Next() {
+    if (++index_ == size_ && !is_plain_) {
+        LoadBlock(block_ + 1);
+    }
+}
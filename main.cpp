@@ -20,7 +20,7 @@ void RemoveDuplicates(SearchServer& search_server) {
 
     for (const int& document_id : search_server) {
         set<string_view> temp;
-        auto& words = search_server.GetWordFrequencies(document_id);
+        const auto words = search_server.GetWordFrequencies(document_id);
         for (const auto& [word, freq] : words) {
             temp.emplace(word);
         }
@@ -142,7 +142,7 @@ int main() {
 
         cout << "Even ids:"s << endl;
         // параллельная версия
-        for (const Document& document : search_server.FindTopDocuments(execution::par, "curly nasty cat"s, [](int document_id, DocumentStatus status, int rating) { return document_id % 2 == 0; })) {
+        for (const Document& document : search_server.FindTopDocuments(execution::par, "curly nasty cat"s, [](int document_id, DocumentStatus, int) { return document_id % 2 == 0; })) {
             PrintDocument(document);
         }
 
@@ -1,16 +1,17 @@
 #pragma once
 
+#include "query_results.h"
 #include "search_server.h"
 
-#include <list>
 #include <string>
-#include <string_view>
 #include <vector>
 
-std::vector<std::vector<Document>> ProcessQueries(
+// Results of the queries for ACTUAL documents, see SearchServer::FindTopDocumentsBatch
+QueryResults ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
-std::list<Document> ProcessQueriesJoined(
+// Documents of all the queries one after another, taken from the batch buffer without copying
+std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
\ No newline at end of file
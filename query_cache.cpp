@@ -0,0 +1,78 @@
+#include "query_cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+using namespace std;
+
+QueryCache::QueryCache(size_t capacity)
+    : capacity_(capacity) {
+    if (capacity == 0) {
+        throw invalid_argument("Query cache capacity must be positive"s);
+    }
+    // Shard capacities differ by at most one and add up to the capacity
+    const size_t shard_count = min(capacity, MAX_SHARD_COUNT);
+    shards_ = vector<Shard>(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_[i].capacity = capacity / shard_count + (i < capacity % shard_count ? 1 : 0);
+    }
+}
+
+size_t QueryCache::GetCapacity() const {
+    return capacity_;
+}
+
+bool QueryCache::Find(string_view key, uint64_t generation, vector<Document>& documents) {
+    Shard& shard = GetShard(key);
+    {
+        lock_guard guard(shard.mutex);
+        const auto it = shard.entry_by_key.find(key);
+        if (it != shard.entry_by_key.end()) {
+            const auto entry_it = it->second;
+            if (entry_it->generation == generation) {
+                shard.entries.splice(shard.entries.begin(), shard.entries, entry_it);
+                documents = entry_it->documents;
+                ++hit_count_;
+                return true;
+            }
+            // An entry of a later generation is left to the queries that see it
+            if (entry_it->generation < generation) {
+                shard.entry_by_key.erase(it);
+                shard.entries.erase(entry_it);
+            }
+        }
+    }
+    ++miss_count_;
+    return false;
+}
+
+void QueryCache::Insert(string_view key, uint64_t generation, const vector<Document>& documents) {
+    Shard& shard = GetShard(key);
+    lock_guard guard(shard.mutex);
+    const auto it = shard.entry_by_key.find(key);
+    if (it != shard.entry_by_key.end()) {
+        const auto entry_it = it->second;
+        if (entry_it->generation <= generation) {
+            entry_it->generation = generation;
+            entry_it->documents = documents;
+            shard.entries.splice(shard.entries.begin(), shard.entries, entry_it);
+        }
+        return;
+    }
+
+    if (shard.entries.size() >= shard.capacity) {
+        shard.entry_by_key.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+    }
+    shard.entries.push_front({ string(key), generation, documents });
+    shard.entry_by_key.emplace(shard.entries.front().key, shard.entries.begin());
+}
+
+QueryCacheStats QueryCache::GetStats() const {
+    return { hit_count_.load(), miss_count_.load() };
+}
+
+QueryCache::Shard& QueryCache::GetShard(string_view key) {
+    return shards_[hash<string_view>{}(key) % shards_.size()];
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "document.h"
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct QueryCacheStats {
+    size_t hit_count = 0;
+    size_t miss_count = 0;
+};
+
+// Bounded LRU cache of search results. Every entry is tagged with the index
+// generation it was computed at and misses lookups of any other generation,
+// so the index invalidates all entries at once by bumping its generation.
+// Keys are spread over shards, each with its own mutex and LRU list.
+class QueryCache {
+public:
+    explicit QueryCache(size_t capacity);
+    QueryCache(const QueryCache&) = delete;
+    QueryCache& operator=(const QueryCache&) = delete;
+
+    size_t GetCapacity() const;
+
+    // Copies the cached documents on a hit
+    bool Find(std::string_view key, uint64_t generation, std::vector<Document>& documents);
+    // Keeps an entry of a later generation under the same key
+    void Insert(std::string_view key, uint64_t generation, const std::vector<Document>& documents);
+
+    QueryCacheStats GetStats() const;
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t generation;
+        std::vector<Document> documents;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        size_t capacity = 0;
+        // Most recently used first
+        std::list<Entry> entries;
+        // Keys point into the entries
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> entry_by_key;
+    };
+
+    static constexpr size_t MAX_SHARD_COUNT = 16;
+
+    size_t capacity_;
+    std::vector<Shard> shards_;
+    std::atomic<size_t> hit_count_ = 0;
+    std::atomic<size_t> miss_count_ = 0;
+
+    Shard& GetShard(std::string_view key);
+};
@@ -0,0 +1,34 @@
+#include "query_results.h"
+
+#include <utility>
+
+using namespace std;
+
+QueryResults::QueryResults(vector<Document> documents, vector<size_t> offsets)
+    : documents_(move(documents))
+    , offsets_(move(offsets)) {
+}
+
+size_t QueryResults::size() const {
+    return offsets_.size() - 1;
+}
+
+QueryResults::DocumentRange QueryResults::operator[](size_t query) const {
+    return { documents_.begin() + offsets_[query], documents_.begin() + offsets_[query + 1] };
+}
+
+QueryResults::Iterator QueryResults::begin() const {
+    return { *this, 0 };
+}
+
+QueryResults::Iterator QueryResults::end() const {
+    return { *this, size() };
+}
+
+const vector<Document>& QueryResults::GetDocuments() const {
+    return documents_;
+}
+
+vector<Document> QueryResults::ReleaseDocuments() && {
+    return move(documents_);
+}
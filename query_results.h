@@ -0,0 +1,60 @@
+#pragma once
+
+#include "document.h"
+#include "paginator.h"
+
+#include <vector>
+
+// Results of a batch of queries in one buffer, in query order. Iterating
+// yields the documents of every query as a range into the buffer.
+class QueryResults {
+public:
+    using DocumentRange = IteratorRange<std::vector<Document>::const_iterator>;
+
+    class Iterator {
+    public:
+        Iterator(const QueryResults& results, size_t query)
+            : results_(&results)
+            , query_(query) {
+        }
+
+        DocumentRange operator*() const {
+            return (*results_)[query_];
+        }
+
+        Iterator& operator++() {
+            ++query_;
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return query_ == other.query_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return query_ != other.query_;
+        }
+
+    private:
+        const QueryResults* results_;
+        size_t query_;
+    };
+
+    QueryResults() = default;
+    // The documents of query i are documents[offsets[i], offsets[i + 1])
+    QueryResults(std::vector<Document> documents, std::vector<size_t> offsets);
+
+    size_t size() const;
+    DocumentRange operator[](size_t query) const;
+
+    Iterator begin() const;
+    Iterator end() const;
+
+    // Documents of all the queries one after another
+    const std::vector<Document>& GetDocuments() const;
+    std::vector<Document> ReleaseDocuments() &&;
+
+private:
+    std::vector<Document> documents_;
+    std::vector<size_t> offsets_ = { 0 };
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+enum class RankingFunction {
+    // Term frequency times log(N / document frequency)
+    TF_IDF,
+    // Okapi BM25: saturating term frequency normalized by the document length
+    BM25,
+};
+
+// Ranking functions score a posting from its term frequency, the share of the
+// document's words the word makes, and the word count of the document. Query
+// evaluation takes them as a template parameter, so each one is inlined into
+// kernels of its own.
+
+struct TfIdfRanking {
+    static double ComputeInverseDocumentFreq(int document_count, int document_freq) {
+        return std::log(document_count * 1.0 / document_freq);
+    }
+
+    double ComputeRelevance(double term_freq, double inverse_document_freq, uint32_t) const {
+        return term_freq * inverse_document_freq;
+    }
+
+    // Bounds the relevance of postings with term frequencies up to max_term_freq
+    double ComputeMaxRelevance(double max_term_freq, double inverse_document_freq) const {
+        return max_term_freq * inverse_document_freq;
+    }
+};
+
+class Bm25Ranking {
+public:
+    static constexpr double K1 = 1.2;
+    static constexpr double B = 0.75;
+
+    explicit Bm25Ranking(double average_word_count)
+        : average_norm_(average_word_count > 0.0 ? K1 * B / average_word_count : 0.0) {
+    }
+
+    static double ComputeInverseDocumentFreq(int document_count, int document_freq) {
+        return std::log(1.0 + (document_count - document_freq + 0.5) / (document_freq + 0.5));
+    }
+
+    // The usual idf * f * (K1 + 1) / (f + K1 * (1 - B + B * word_count / average_word_count))
+    // with the occurrence count f = term_freq * word_count divided through by word_count
+    double ComputeRelevance(double term_freq, double inverse_document_freq, uint32_t word_count) const {
+        return inverse_document_freq * (K1 + 1.0) * term_freq / (term_freq + K1 * (1.0 - B) / word_count + average_norm_);
+    }
+
+    // Dropping the length term only raises the relevance
+    double ComputeMaxRelevance(double max_term_freq, double inverse_document_freq) const {
+        return inverse_document_freq * (K1 + 1.0) * max_term_freq / (max_term_freq + average_norm_);
+    }
+
+private:
+    double average_norm_;
+};
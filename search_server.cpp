@@ -1,8 +1,27 @@
 #include "search_server.h"
 #include "string_processing.h"
 
+#include <charconv>
+#include <optional>
+
 using namespace std;
 
+namespace {
+
+// Returns 0 unless the word is NEAR/k with a positive k
+uint32_t ParseNearOperator(string_view word) {
+    static constexpr string_view PREFIX = "NEAR/"sv;
+    if (word.size() <= PREFIX.size() || word.substr(0, PREFIX.size()) != PREFIX) {
+        return 0;
+    }
+    const char* const end = word.data() + word.size();
+    uint32_t max_distance = 0;
+    const auto [last, error] = from_chars(word.data() + PREFIX.size(), end, max_distance);
+    return error == errc() && last == end ? max_distance : 0;
+}
+
+} // namespace
+
 SearchServer::SearchServer(const string& stop_words_view)
     : SearchServer(SplitIntoWords(stop_words_view)) {
 }
@@ -11,28 +30,177 @@ SearchServer::SearchServer(string_view stop_words_view)
     : SearchServer(SplitIntoWords(stop_words_view)) {
 }
 
+SearchServer::SearchServer(shared_ptr<const IndexSnapshot> snapshot)
+    : snapshot_(move(snapshot)) {
+    IndexReplica& replica = *replicas_[0];
+    InvertedIndex& index = replica.word_to_document_freqs;
+    const SnapshotHeader& header = snapshot_->GetHeader();
+    const auto read_strings = [this](const SnapshotSection& offsets_section, const SnapshotSection& chars_section, auto add) {
+        const uint64_t* offsets = snapshot_->GetSection<uint64_t>(offsets_section);
+        const char* chars = snapshot_->GetSection<char>(chars_section);
+        for (uint64_t i = 0; i + 1 < offsets_section.size; ++i) {
+            if (offsets[i] > offsets[i + 1] || offsets[i + 1] > chars_section.size) {
+                throw invalid_argument("Snapshot is corrupted"s);
+            }
+            add(string_view(chars + offsets[i], offsets[i + 1] - offsets[i]));
+        }
+    };
+
+    read_strings(header.stop_word_offsets, header.stop_word_chars, [this](string_view word) {
+        stop_words_.emplace(word);
+    });
+    // Terms are looked up in the mapped tables, which are only checked here
+    if (header.term_offsets.size == 0) {
+        throw invalid_argument("Snapshot is corrupted"s);
+    }
+    const size_t term_count = header.term_offsets.size - 1;
+    read_strings(header.term_offsets, header.term_chars, [](string_view) {
+    });
+    const int32_t* sorted_term_ids = snapshot_->GetSection<int32_t>(header.sorted_term_ids);
+    const auto is_term_id = [term_count](int32_t term_id) {
+        return term_id >= 0 && static_cast<size_t>(term_id) < term_count;
+    };
+    if (header.sorted_term_ids.size != term_count || term_count > static_cast<size_t>(numeric_limits<int>::max())
+        || !all_of(sorted_term_ids, sorted_term_ids + term_count, is_term_id)) {
+        throw invalid_argument("Snapshot is corrupted"s);
+    }
+    index.SetMappedTerms(snapshot_->GetSection<uint64_t>(header.term_offsets), snapshot_->GetSection<char>(header.term_chars),
+        sorted_term_ids, term_count);
+    // Strictly increasing terms also make the ids a permutation
+    const TermDictionary& terms = index.GetTerms();
+    const bool has_sorted_terms = adjacent_find(sorted_term_ids, sorted_term_ids + term_count, [&terms](int32_t lhs, int32_t rhs) {
+        return terms.GetTerm(lhs) >= terms.GetTerm(rhs);
+    }) == sorted_term_ids + term_count;
+    if (!has_sorted_terms) {
+        throw invalid_argument("Snapshot is corrupted"s);
+    }
+
+    const SnapshotPostingList* posting_lists = snapshot_->GetSection<SnapshotPostingList>(header.posting_lists);
+    const int* posting_document_ids = snapshot_->GetSection<int32_t>(header.posting_document_ids);
+    const double* posting_term_freqs = snapshot_->GetSection<double>(header.posting_term_freqs);
+    const size_t document_count = header.documents.size;
+    if (header.posting_lists.size != term_count || header.posting_term_freqs.size != header.posting_document_ids.size
+        || document_count > static_cast<size_t>(numeric_limits<int>::max())) {
+        throw invalid_argument("Snapshot is corrupted"s);
+    }
+    // Queries index documents by the ordinals of the postings without checking them
+    const bool has_valid_ordinals = all_of(posting_document_ids, posting_document_ids + header.posting_document_ids.size,
+        [document_count](int32_t ordinal) {
+            return ordinal >= 0 && static_cast<size_t>(ordinal) < document_count;
+        });
+    if (!has_valid_ordinals) {
+        throw invalid_argument("Snapshot is corrupted"s);
+    }
+    for (size_t term_id = 0; term_id < term_count; ++term_id) {
+        const SnapshotPostingList& entry = posting_lists[term_id];
+        if (entry.begin > header.posting_document_ids.size || entry.size > header.posting_document_ids.size - entry.begin) {
+            throw invalid_argument("Snapshot is corrupted"s);
+        }
+        index.SetPostings(static_cast<int>(term_id), PostingList::FromMapped(
+            posting_document_ids + entry.begin, posting_term_freqs + entry.begin, entry.size, entry.max_term_freq));
+    }
+
+    const SnapshotDocument* documents = snapshot_->GetSection<SnapshotDocument>(header.documents);
+    const TermFreq* forward_terms = snapshot_->GetSection<TermFreq>(header.forward_terms);
+    const bool has_valid_term_ids = all_of(forward_terms, forward_terms + header.forward_terms.size, [&is_term_id](const TermFreq& term_freq) {
+        return is_term_id(term_freq.term_id);
+    });
+    if (!has_valid_term_ids) {
+        throw invalid_argument("Snapshot is corrupted"s);
+    }
+    replica.documents.reserve(document_count);
+    replica.document_columns.Reserve(document_count);
+    replica.document_ordinals.reserve(document_count);
+    for (size_t ordinal = 0; ordinal < document_count; ++ordinal) {
+        const SnapshotDocument& document = documents[ordinal];
+        if (document.forward_begin > header.forward_terms.size || document.forward_size > header.forward_terms.size - document.forward_begin
+            || document.forward_size > term_count || !replica.document_ordinals.emplace(document.id, static_cast<int>(ordinal)).second) {
+            throw invalid_argument("Snapshot is corrupted"s);
+        }
+        if (document.status < 0 || document.status >= static_cast<int32_t>(DOCUMENT_STATUS_COUNT)) {
+            throw invalid_argument("Snapshot is corrupted"s);
+        }
+        // The forward index is read in place; the snapshot outlives the replicas, so nothing owns it
+        const shared_ptr<const TermFreq> term_freqs(shared_ptr<const TermFreq>(), forward_terms + document.forward_begin);
+        replica.documents.push_back({ document.id, document.word_count, term_freqs, static_cast<uint32_t>(document.forward_size) });
+        replica.document_columns.Add(static_cast<DocumentStatus>(document.status), document.rating);
+        replica.word_count += document.word_count;
+        document_ids_.insert(document.id);
+        index.AddDocument(static_cast<int>(ordinal));
+    }
+    replica.is_removed.assign(replica.documents.size(), false);
+    if (header.position_offsets.size > 0) {
+        ReadPositions(header, replica);
+    }
+    // The mapped posting lists form one sealed segment
+    if (!replica.documents.empty()) {
+        index.SealMutableSegment(static_cast<int>(replica.documents.size()));
+    }
+}
+
+SearchServer::~SearchServer() {
+    unique_lock lock(writer_mutex_);
+    PauseMerges(lock);
+}
+
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    unique_lock lock(writer_mutex_);
+    if ((document_id < 0) || (replicas_[0]->document_ordinals.count(document_id) > 0)) {
         throw invalid_argument("Invalid document_id"s);
     }
-    const auto words = SplitIntoWordsNoStop(document);
+    const DocumentWords document_words = ComputeWordFreqs(document);
+    const auto& word_freqs = document_words.word_freqs;
+    const shared_ptr<WriteAheadLog> log = write_ahead_log_;
+    const uint64_t log_sequence = log ? log->LogAddDocument(document_id, document, status, ratings) : 0;
 
-    const double inv_word_count = 1.0 / words.size();
-    set<string, less<>> doc_words;
-    for (string_view word : words) {
-        doc_words.emplace(word.substr());
-        auto iter = doc_words.find(word);
-        word_to_document_freqs_[*iter][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][*iter] += inv_word_count;
-    }
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status, move(doc_words) });
+    const int ordinal = static_cast<int>(replicas_[0]->documents.size());
+    const int rating = ComputeAverageRating(ratings);
+    shared_ptr<const TermFreqs> term_freqs;
+    shared_ptr<const DocumentPositions> positions;
+    ModifyReplicas([&](IndexReplica& replica) {
+        InvertedIndex& index = replica.word_to_document_freqs;
+        TermFreqs document_term_freqs;
+        document_term_freqs.reserve(word_freqs.size());
+        for (const auto& [word, term_freq] : word_freqs) {
+            const int term_id = index.AddTerm(word);
+            index.Add(term_id, ordinal, term_freq);
+            document_term_freqs.push_back({ term_id, term_freq });
+        }
+        // Replicas assign the same term ids
+        if (!term_freqs) {
+            SortTermFreqs(document_term_freqs);
+            term_freqs = make_shared<const TermFreqs>(move(document_term_freqs));
+            if (is_positional_) {
+                positions = MakeDocumentPositions(*term_freqs, index.GetTerms(), document_words.word_positions);
+            }
+        }
+        replica.documents.push_back(MakeDocumentData(document_id, document_words.word_count, term_freqs));
+        if (is_positional_) {
+            replica.document_positions.push_back(positions);
+        }
+        replica.document_columns.Add(status, rating);
+        replica.word_count += document_words.word_count;
+        replica.is_removed.push_back(false);
+        replica.document_ordinals.emplace(document_id, ordinal);
+        index.AddDocument(ordinal);
+        SealMutableSegmentIfNeeded(replica);
+    });
+    ++generation_;
     document_ids_.insert(document_id);
+    StartMergesIfNeeded();
+    // Writers waiting for one sync share it
+    lock.unlock();
+    if (log) {
+        log->Sync(log_sequence);
+    }
+}
+
+void SearchServer::AddDocuments(const vector<NewDocument>& documents) {
+    AddDocuments(std::execution::seq, documents);
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status;
-        });
+    return FindTopDocuments(std::execution::seq, raw_query, status);
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
@@ -40,7 +208,9 @@ vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
 }
 
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return ReadReplica([](const IndexReplica& replica) {
+        return static_cast<int>(replica.document_ordinals.size());
+    });
 }
 
 std::set<int>::const_iterator SearchServer::begin() const {
@@ -51,12 +221,19 @@ std::set<int>::const_iterator SearchServer::end() const {
     return document_ids_.end();
 }
 
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    static map<string_view, double> empty_map;
-    if (document_to_word_freqs_.count(document_id) > 0) {
-        return document_to_word_freqs_.at(document_id);
-    }
-    return empty_map;
+map<string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+    return ReadReplica([document_id](const IndexReplica& replica) {
+        map<string_view, double> word_freqs;
+        const auto ordinal_it = replica.document_ordinals.find(document_id);
+        if (ordinal_it == replica.document_ordinals.end()) {
+            return word_freqs;
+        }
+        const TermDictionary& terms = replica.word_to_document_freqs.GetTerms();
+        for (const auto& [term_id, term_freq] : replica.documents[ordinal_it->second].GetTermFreqs()) {
+            word_freqs.emplace(terms.GetTerm(term_id), term_freq);
+        }
+        return word_freqs;
+    });
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_view raw_query, int document_id) const {
@@ -67,6 +244,310 @@ void SearchServer::RemoveDocument(int document_id) {
     RemoveDocument(std::execution::seq, document_id);
 }
 
+void SearchServer::SetPostingListEncoding(PostingListEncoding encoding) {
+    unique_lock lock(writer_mutex_);
+    // A merge running meanwhile would put back a segment of the old encoding
+    PauseMerges(lock);
+    ModifyReplicas([encoding](IndexReplica& replica) {
+        replica.word_to_document_freqs.SetEncoding(encoding);
+    });
+    // Compressed term frequencies are rounded
+    ++generation_;
+    ResumeMerges();
+}
+
+void SearchServer::SetImpactOrder(bool has_impact_order) {
+    unique_lock lock(writer_mutex_);
+    // A merge running meanwhile would put back a segment without the order
+    PauseMerges(lock);
+    ModifyReplicas([has_impact_order](IndexReplica& replica) {
+        replica.word_to_document_freqs.SetImpactOrder(has_impact_order);
+    });
+    ResumeMerges();
+}
+
+void SearchServer::SetPositionalIndex(bool is_positional) {
+    lock_guard guard(writer_mutex_);
+    if (is_positional == is_positional_) {
+        return;
+    }
+    if (is_positional && !replicas_[0]->documents.empty()) {
+        throw invalid_argument("Positional index must be turned on before documents are added"s);
+    }
+    ModifyReplicas([](IndexReplica& replica) {
+        replica.document_positions.clear();
+        replica.document_positions.shrink_to_fit();
+    });
+    is_positional_ = is_positional;
+    // Cached phrase queries must not outlive the positions
+    ++generation_;
+}
+
+void SearchServer::SetQueryEvaluation(QueryEvaluation evaluation) {
+    query_evaluation_ = evaluation;
+}
+
+void SearchServer::SetRankingFunction(RankingFunction ranking_function) {
+    ranking_function_ = ranking_function;
+    ++generation_;
+}
+
+void SearchServer::SetWorkerCount(size_t worker_count) {
+    worker_count_ = max<size_t>(worker_count, 1);
+}
+
+void SearchServer::SetThreadPool(shared_ptr<ThreadPool> thread_pool) {
+    thread_pool_ = move(thread_pool);
+}
+
+ThreadPool& SearchServer::GetThreadPool() const {
+    return *thread_pool_;
+}
+
+void SearchServer::SetRemovalMode(RemovalMode mode) {
+    lock_guard guard(writer_mutex_);
+    removal_mode_ = mode;
+}
+
+void SearchServer::SetCompactionThreshold(double removed_share) {
+    if (!(removed_share >= 0.0)) {
+        throw invalid_argument("Compaction threshold must not be negative"s);
+    }
+    lock_guard guard(writer_mutex_);
+    compaction_threshold_ = removed_share;
+}
+
+void SearchServer::SetSegmentSize(size_t document_count) {
+    if (document_count == 0) {
+        throw invalid_argument("Segment size must be positive"s);
+    }
+    lock_guard guard(writer_mutex_);
+    segment_size_ = document_count;
+}
+
+void SearchServer::WaitForMerges() {
+    unique_lock lock(writer_mutex_);
+    merges_finished_.wait(lock, [this] {
+        return !is_merging_;
+    });
+}
+
+void SearchServer::SetReadConcurrency(ReadConcurrency concurrency) {
+    lock_guard guard(writer_mutex_);
+    if (concurrency == read_concurrency_) {
+        return;
+    }
+    if (concurrency == ReadConcurrency::LOCK_FREE) {
+        replicas_[1] = make_unique<IndexReplica>(*replicas_[0]);
+        read_index_ = 0;
+    }
+    else {
+        replicas_[0] = move(replicas_[read_index_]);
+        replicas_[1].reset();
+    }
+    read_concurrency_ = concurrency;
+}
+
+void SearchServer::SetQueryCacheCapacity(size_t capacity) {
+    if (capacity == 0) {
+        query_cache_.reset();
+    }
+    else if (!query_cache_ || query_cache_->GetCapacity() != capacity) {
+        query_cache_ = make_unique<QueryCache>(capacity);
+    }
+}
+
+QueryCacheStats SearchServer::GetQueryCacheStats() const {
+    return query_cache_ ? query_cache_->GetStats() : QueryCacheStats{};
+}
+
+void SearchServer::AddCollectionStats(string_view raw_query, CollectionStats& stats) const {
+    const Query query = ParseQuery(raw_query);
+    ReadReplica([&query, &stats](const IndexReplica& replica) {
+        const InvertedIndex& index = replica.word_to_document_freqs;
+        stats.document_count += static_cast<int>(replica.document_ordinals.size());
+        stats.word_count += replica.word_count;
+        for (const string_view word : query.plus_words) {
+            const int term_id = index.FindTerm(word);
+            stats.document_freqs[word] += term_id == TermDictionary::NO_TERM ? 0 : static_cast<int>(index.GetDocumentFreq(term_id));
+        }
+    });
+}
+
+QueryResults SearchServer::FindTopDocumentsBatch(const vector<string>& raw_queries, DocumentStatus status, size_t max_count) const {
+    // Identical queries are run once
+    vector<Query> queries;
+    vector<size_t> query_indexes;
+    query_indexes.reserve(raw_queries.size());
+    unordered_map<string, size_t> key_to_query_index;
+    for (const string& raw_query : raw_queries) {
+        Query query = ParseQuery(raw_query);
+        const auto [it, is_new] = key_to_query_index.emplace(MakeQueryCacheKey(query, status, max_count), queries.size());
+        if (is_new) {
+            queries.push_back(move(query));
+        }
+        query_indexes.push_back(it->second);
+    }
+
+    vector<vector<Document>> query_documents(queries.size());
+    if (max_count > 0) {
+        ReadReplica([&](const IndexReplica& replica) {
+            FindBatchDocuments(replica, queries, status, max_count, query_documents);
+        });
+    }
+
+    vector<Document> documents;
+    vector<size_t> offsets = { 0 };
+    offsets.reserve(raw_queries.size() + 1);
+    for (const size_t query_index : query_indexes) {
+        documents.insert(documents.end(), query_documents[query_index].begin(), query_documents[query_index].end());
+        offsets.push_back(documents.size());
+    }
+    return { move(documents), move(offsets) };
+}
+
+void SearchServer::SaveSnapshot(const string& path) const {
+    ReadReplica([this, &path](const IndexReplica& replica) {
+        WriteSnapshot(replica, path);
+    });
+}
+
+void SearchServer::WriteSnapshot(const IndexReplica& replica, const string& path) const {
+    SnapshotWriter writer(path);
+    SnapshotHeader header;
+
+    const auto write_strings = [&writer](const auto& strings, SnapshotSection& offsets_section, SnapshotSection& chars_section) {
+        vector<uint64_t> offsets = { 0 };
+        for (string_view word : strings) {
+            offsets.push_back(offsets.back() + word.size());
+        }
+        writer.BeginSection();
+        writer.Write(offsets);
+        offsets_section = writer.EndSection(offsets.size());
+        writer.BeginSection();
+        for (string_view word : strings) {
+            writer.Write(word.data(), word.size());
+        }
+        chars_section = writer.EndSection(offsets.back());
+    };
+
+    write_strings(stop_words_, header.stop_word_offsets, header.stop_word_chars);
+    const TermDictionary& terms = replica.word_to_document_freqs.GetTerms();
+    vector<string_view> words(terms.Size());
+    for (size_t term_id = 0; term_id < words.size(); ++term_id) {
+        words[term_id] = terms.GetTerm(static_cast<int>(term_id));
+    }
+    write_strings(words, header.term_offsets, header.term_chars);
+    vector<int32_t> sorted_term_ids(words.size());
+    iota(sorted_term_ids.begin(), sorted_term_ids.end(), 0);
+    sort(sorted_term_ids.begin(), sorted_term_ids.end(), [&words](int32_t lhs, int32_t rhs) {
+        return words[lhs] < words[rhs];
+    });
+    writer.BeginSection();
+    writer.Write(sorted_term_ids);
+    header.sorted_term_ids = writer.EndSection(sorted_term_ids.size());
+
+    // Documents keep their order, so renumbered posting lists stay sorted
+    vector<int> new_ordinals(replica.documents.size(), -1);
+    int document_count = 0;
+    for (size_t ordinal = 0; ordinal < replica.documents.size(); ++ordinal) {
+        const auto ordinal_it = replica.document_ordinals.find(replica.documents[ordinal].id);
+        if (ordinal_it != replica.document_ordinals.end() && ordinal_it->second == static_cast<int>(ordinal)) {
+            new_ordinals[ordinal] = document_count++;
+        }
+    }
+
+    // Document ids and term frequencies go to separate sections, so every list is read twice
+    // Segments are in ordinal order, so the postings of a term are concatenated segment by segment
+    const auto for_each_posting = [&replica](int term_id, auto function) {
+        for (size_t i = 0; i < replica.word_to_document_freqs.GetSegmentCount(); ++i) {
+            if (const PostingList* postings = replica.word_to_document_freqs.GetSegment(i).Find(term_id)) {
+                postings->ForEach(function);
+            }
+        }
+    };
+    vector<SnapshotPostingList> posting_lists;
+    posting_lists.reserve(words.size());
+    uint64_t posting_count = 0;
+    vector<int32_t> document_ids;
+    writer.BeginSection();
+    for (size_t term_id = 0; term_id < words.size(); ++term_id) {
+        SnapshotPostingList entry = { posting_count, 0, 0.0 };
+        document_ids.clear();
+        for_each_posting(static_cast<int>(term_id), [&](int ordinal, double term_freq) {
+            if (new_ordinals[ordinal] >= 0) {
+                document_ids.push_back(new_ordinals[ordinal]);
+                entry.max_term_freq = max(entry.max_term_freq, term_freq);
+            }
+        });
+        writer.Write(document_ids);
+        entry.size = document_ids.size();
+        posting_count += entry.size;
+        posting_lists.push_back(entry);
+    }
+    header.posting_document_ids = writer.EndSection(posting_count);
+    vector<double> term_freqs;
+    writer.BeginSection();
+    for (size_t term_id = 0; term_id < words.size(); ++term_id) {
+        term_freqs.clear();
+        for_each_posting(static_cast<int>(term_id), [&](int ordinal, double term_freq) {
+            if (new_ordinals[ordinal] >= 0) {
+                term_freqs.push_back(term_freq);
+            }
+        });
+        writer.Write(term_freqs);
+    }
+    header.posting_term_freqs = writer.EndSection(posting_count);
+    writer.BeginSection();
+    writer.Write(posting_lists);
+    header.posting_lists = writer.EndSection(posting_lists.size());
+
+    vector<SnapshotDocument> documents;
+    documents.reserve(document_count);
+    uint64_t forward_size = 0;
+    writer.BeginSection();
+    for (size_t ordinal = 0; ordinal < replica.documents.size(); ++ordinal) {
+        if (new_ordinals[ordinal] < 0) {
+            continue;
+        }
+        const DocumentData& document = replica.documents[ordinal];
+        const DocumentColumns& columns = replica.document_columns;
+        documents.push_back({ document.id, columns.GetRating(static_cast<int>(ordinal)), static_cast<int32_t>(columns.GetStatus(static_cast<int>(ordinal))),
+            document.word_count, forward_size, document.term_count });
+        writer.Write(document.term_freqs.get(), document.term_count);
+        forward_size += document.term_count;
+    }
+    header.forward_terms = writer.EndSection(forward_size);
+    writer.BeginSection();
+    writer.Write(documents);
+    header.documents = writer.EndSection(documents.size());
+
+    // Positions are saved because the snapshot has no text to rebuild them from
+    if (is_positional_) {
+        vector<uint64_t> position_offsets = { 0 };
+        position_offsets.reserve(documents.size() + 1);
+        writer.BeginSection();
+        for (size_t ordinal = 0; ordinal < replica.documents.size(); ++ordinal) {
+            if (new_ordinals[ordinal] >= 0) {
+                const DocumentPositions& positions = *replica.document_positions[ordinal];
+                writer.Write(positions.GetData(), positions.GetSize());
+                position_offsets.push_back(position_offsets.back() + positions.GetSize());
+            }
+        }
+        header.position_data = writer.EndSection(position_offsets.back());
+        writer.BeginSection();
+        writer.Write(position_offsets);
+        header.position_offsets = writer.EndSection(position_offsets.size());
+    }
+
+    writer.Finish(header);
+}
+
+void SearchServer::SetWriteAheadLog(shared_ptr<WriteAheadLog> write_ahead_log) {
+    lock_guard guard(writer_mutex_);
+    write_ahead_log_ = move(write_ahead_log);
+}
+
 //private:
 bool SearchServer::IsStopWord(string_view word) const {
     return stop_words_.count(word) > 0;
@@ -74,42 +555,178 @@ bool SearchServer::IsStopWord(string_view word) const {
 
 bool SearchServer::IsValidWord(string_view word) {
     // A valid word must not contain special characters
-    return none_of(word.begin(), word.end(), [](char c) {
-        return c >= '\0' && c < ' ';
-        });
+    for (size_t block = 0; block < word.size(); block += MASK_BLOCK_SIZE) {
+        if (ScanBlock(word.data() + block, min(MASK_BLOCK_SIZE, word.size() - block)).control_chars != 0) {
+            return false;
+        }
+    }
+    return true;
 }
 
 vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
     vector<string_view> words;
-    for (const string_view& word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
+    ForEachWord(text, [this, &words](string_view word, bool is_valid) {
+        if (!is_valid) {
             string s(word.substr());
             throw invalid_argument("Word "s + s + " is invalid");
         }
         if (!IsStopWord(word)) {
             words.push_back(word);
         }
-    }
+    });
     return words;
 }
 
 SearchServer::Query SearchServer::ParseQuery(string_view text) const {
     SearchServer::Query result;
-    for (const string_view& word : SplitIntoWords(text)) {
-        const auto query_word = ParseQueryWord(word);
+    // Quotes and NEAR/k are parts of ordinary words without the positional index
+    if (!is_positional_) {
+        ForEachWord(text, [this, &result](string_view word, bool is_valid) {
+            const auto query_word = ParseQueryWord(word, is_valid);
+            if (!query_word.is_stop) {
+                if (query_word.is_minus) {
+                    result.minus_words.Insert(query_word.data);
+                }
+                else {
+                    result.plus_words.Insert(query_word.data);
+                }
+            }
+        });
+        return result;
+    }
+
+    // Phrase being parsed and the offset of its next word
+    bool is_in_phrase = false;
+    QueryPhrase phrase;
+    uint32_t phrase_offset = 0;
+    // Previous word if it is a plus-word, the left operand of a NEAR/k
+    optional<QueryWord> last_plus_word;
+    // Distance of a NEAR/k waiting for its right operand
+    uint32_t near_distance = 0;
+    ForEachWord(text, [&](string_view word, bool is_valid) {
+        if (!is_in_phrase && !word.empty() && word.front() == '"') {
+            is_in_phrase = true;
+            phrase_offset = 0;
+            word.remove_prefix(1);
+        }
+        if (is_in_phrase) {
+            if (near_distance > 0) {
+                throw invalid_argument("NEAR/k must stand between two words"s);
+            }
+            last_plus_word.reset();
+            const bool is_phrase_end = !word.empty() && word.back() == '"';
+            if (is_phrase_end) {
+                word.remove_suffix(1);
+            }
+            const auto query_word = ParseQueryWord(word, is_valid);
+            if (query_word.is_minus) {
+                throw invalid_argument("Query phrase word "s + string(word) + " is invalid");
+            }
+            // Stop words are left out but keep their place
+            if (!query_word.is_stop) {
+                phrase.words.emplace_back(query_word.data, phrase_offset);
+                result.plus_words.Insert(query_word.data);
+            }
+            ++phrase_offset;
+            if (is_phrase_end) {
+                is_in_phrase = false;
+                if (!phrase.words.empty()) {
+                    const uint32_t first_offset = phrase.words.front().second;
+                    for (auto& [phrase_word, offset] : phrase.words) {
+                        offset -= first_offset;
+                    }
+                    result.phrases.push_back(move(phrase));
+                }
+                phrase = {};
+            }
+            return;
+        }
+
+        if (const uint32_t max_distance = ParseNearOperator(word); max_distance > 0) {
+            if (!last_plus_word || near_distance > 0) {
+                throw invalid_argument("NEAR/k must stand between two words"s);
+            }
+            near_distance = max_distance;
+            return;
+        }
+        const auto query_word = ParseQueryWord(word, is_valid);
+        if (query_word.is_minus && query_word.data.front() == '"') {
+            throw invalid_argument("Query word "s + string(word) + " is invalid");
+        }
+        if (near_distance > 0) {
+            if (query_word.is_minus) {
+                throw invalid_argument("NEAR/k must stand between two words"s);
+            }
+            // A stop word leaves nothing to be near
+            if (!query_word.is_stop && !last_plus_word->is_stop) {
+                result.proximities.push_back({ last_plus_word->data, query_word.data, near_distance });
+            }
+            near_distance = 0;
+        }
         if (!query_word.is_stop) {
             if (query_word.is_minus) {
-                result.minus_words.insert(query_word.data.substr());
+                result.minus_words.Insert(query_word.data);
             }
             else {
-                result.plus_words.insert(query_word.data.substr());
+                result.plus_words.Insert(query_word.data);
             }
         }
-    }
+        if (query_word.is_minus) {
+            last_plus_word.reset();
+        }
+        else {
+            last_plus_word = query_word;
+        }
+    });
 
+    if (is_in_phrase) {
+        throw invalid_argument("Query phrase is not closed"s);
+    }
+    if (near_distance > 0) {
+        throw invalid_argument("NEAR/k must stand between two words"s);
+    }
     return result;
 }
 
+string SearchServer::MakeQueryCacheKey(const Query& query, DocumentStatus status, size_t max_count) {
+    // Words never contain spaces or control characters
+    string key;
+    for (const string_view word : query.plus_words) {
+        key += word;
+        key += ' ';
+    }
+    key += '\n';
+    for (const string_view word : query.minus_words) {
+        key += word;
+        key += ' ';
+    }
+    key += '\n';
+    // Offsets and words alternate; tabs end phrases and proximities
+    for (const QueryPhrase& phrase : query.phrases) {
+        for (const auto& [word, offset] : phrase.words) {
+            key += to_string(offset);
+            key += ' ';
+            key += word;
+            key += ' ';
+        }
+        key += '\t';
+    }
+    key += '\n';
+    for (const QueryProximity& proximity : query.proximities) {
+        key += proximity.first;
+        key += ' ';
+        key += proximity.second;
+        key += ' ';
+        key += to_string(proximity.max_distance);
+        key += '\t';
+    }
+    key += '\n';
+    key += to_string(static_cast<int>(status));
+    key += ' ';
+    key += to_string(max_count);
+    return key;
+}
+
 int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
     if (ratings.empty()) {
         return 0;
@@ -121,24 +738,491 @@ int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
     return rating_sum / static_cast<int>(ratings.size());
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
+SearchServer::DocumentWords SearchServer::ComputeWordFreqs(string_view text) const {
+    const auto words = SplitIntoWordsNoStop(text);
+
+    const double inv_word_count = 1.0 / words.size();
+    DocumentWords result;
+    for (string_view word : words) {
+        result.word_freqs[word] += inv_word_count;
+    }
+    result.word_count = static_cast<uint32_t>(words.size());
+    if (is_positional_) {
+        // Stop words take positions, so phrases skipping them still match
+        uint32_t position = 0;
+        ForEachWord(text, [this, &result, &position](string_view word, bool) {
+            if (!IsStopWord(word)) {
+                result.word_positions[word].push_back(position);
+            }
+            ++position;
+        });
+    }
+    return result;
+}
+
+void SearchServer::ReadPositions(const SnapshotHeader& header, IndexReplica& replica) {
+    const uint64_t* offsets = snapshot_->GetSection<uint64_t>(header.position_offsets);
+    const uint8_t* data = snapshot_->GetSection<uint8_t>(header.position_data);
+    if (header.position_offsets.size != replica.documents.size() + 1 || offsets[0] != 0) {
+        throw invalid_argument("Snapshot is corrupted"s);
+    }
+    // One allocation holds the positions of every document, which are read in place
+    auto positions = make_shared<vector<DocumentPositions>>();
+    positions->reserve(replica.documents.size());
+    replica.document_positions.reserve(replica.documents.size());
+    for (size_t ordinal = 0; ordinal < replica.documents.size(); ++ordinal) {
+        if (offsets[ordinal] > offsets[ordinal + 1] || offsets[ordinal + 1] > header.position_data.size) {
+            throw invalid_argument("Snapshot is corrupted"s);
+        }
+        positions->emplace_back(data + offsets[ordinal], offsets[ordinal + 1] - offsets[ordinal]);
+        if (!positions->back().IsValid(replica.documents[ordinal].term_count)) {
+            throw invalid_argument("Snapshot is corrupted"s);
+        }
+        replica.document_positions.emplace_back(positions, &positions->back());
+    }
+    is_positional_ = true;
+}
+
+void SearchServer::SortTermFreqs(TermFreqs& term_freqs) {
+    sort(term_freqs.begin(), term_freqs.end(), [](const TermFreq& lhs, const TermFreq& rhs) {
+        return lhs.term_id < rhs.term_id;
+    });
+}
+
+SearchServer::DocumentData SearchServer::MakeDocumentData(int id, uint32_t word_count, const shared_ptr<const TermFreqs>& term_freqs) {
+    // The entries share the ownership of the vector
+    return { id, word_count, shared_ptr<const TermFreq>(term_freqs, term_freqs->data()), static_cast<uint32_t>(term_freqs->size()) };
+}
+
+shared_ptr<const DocumentPositions> SearchServer::MakeDocumentPositions(const TermFreqs& term_freqs, const TermDictionary& terms,
+    const map<string_view, vector<uint32_t>>& word_positions) {
+    vector<vector<uint32_t>> term_positions;
+    term_positions.reserve(term_freqs.size());
+    for (const auto& [term_id, term_freq] : term_freqs) {
+        const auto it = word_positions.find(terms.GetTerm(term_id));
+        term_positions.push_back(it != word_positions.end() ? it->second : vector<uint32_t>{});
+    }
+    return make_shared<const DocumentPositions>(term_positions);
+}
+
+void SearchServer::CheckNewDocumentIds(const vector<NewDocument>& documents) const {
+    vector<int> document_ids;
+    document_ids.reserve(documents.size());
+    for (const NewDocument& document : documents) {
+        if ((document.id < 0) || (replicas_[0]->document_ordinals.count(document.id) > 0)) {
+            throw invalid_argument("Invalid document_id"s);
+        }
+        document_ids.push_back(document.id);
+    }
+    sort(document_ids.begin(), document_ids.end());
+    if (adjacent_find(document_ids.begin(), document_ids.end()) != document_ids.end()) {
+        throw invalid_argument("Invalid document_id"s);
+    }
+}
+
+void SearchServer::AddIndexedDocuments(IndexReplica& replica, const vector<NewDocument>& documents,
+    const vector<uint32_t>& word_counts, const vector<shared_ptr<const TermFreqs>>& term_freqs,
+    const vector<shared_ptr<const DocumentPositions>>& positions) const {
+    int ordinal = static_cast<int>(replica.documents.size());
+    replica.documents.reserve(replica.documents.size() + documents.size());
+    if (!positions.empty()) {
+        replica.document_positions.insert(replica.document_positions.end(), positions.begin(), positions.end());
+    }
+    replica.document_columns.Reserve(replica.documents.size() + documents.size());
+    replica.is_removed.reserve(replica.is_removed.size() + documents.size());
+    replica.document_ordinals.reserve(replica.document_ordinals.size() + documents.size());
+    for (size_t i = 0; i < documents.size(); ++i, ++ordinal) {
+        const NewDocument& document = documents[i];
+        replica.documents.push_back(MakeDocumentData(document.id, word_counts[i], term_freqs[i]));
+        replica.document_columns.Add(document.status, ComputeAverageRating(document.ratings));
+        replica.word_count += word_counts[i];
+        replica.is_removed.push_back(false);
+        replica.document_ordinals.emplace(document.id, ordinal);
+        replica.word_to_document_freqs.AddDocument(ordinal);
+    }
+    SealMutableSegmentIfNeeded(replica);
+}
+
+SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text, bool is_valid) const {
     if (text.empty()) {
         throw invalid_argument("Query word is empty"s);
     }
-    string word(text.substr());
+    // Only the error message copies the word
+    string_view word = text;
     bool is_minus = false;
-    string_view new_text = text;
     if (word[0] == '-') {
         is_minus = true;
-        word = word.substr(1);
-        new_text = text.substr(1);
+        word.remove_prefix(1);
     }
-    if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
-        throw invalid_argument("Query word "s + word + " is invalid");
+    if (word.empty() || word[0] == '-' || !is_valid) {
+        throw invalid_argument("Query word "s + string(word) + " is invalid");
     }
-    return { new_text, is_minus, IsStopWord(word) };
+    return { word, is_minus, IsStopWord(word) };
+}
+
+double SearchServer::ComputeInverseDocumentFreq(int document_count, int document_freq) const {
+    return ranking_function_ == RankingFunction::BM25
+        ? Bm25Ranking::ComputeInverseDocumentFreq(document_count, document_freq)
+        : TfIdfRanking::ComputeInverseDocumentFreq(document_count, document_freq);
+}
+
+double SearchServer::ComputeWordInverseDocumentFreq(const IndexReplica& replica, int term_id) const {
+    return ComputeInverseDocumentFreq(static_cast<int>(replica.document_ordinals.size()),
+        static_cast<int>(replica.word_to_document_freqs.GetDocumentFreq(term_id)));
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
-}
\ No newline at end of file
+double SearchServer::ComputeWordInverseDocumentFreq(const IndexReplica& replica, int term_id, string_view word, const CollectionStats* stats) const {
+    if (stats) {
+        // Documents added after the stats were collected may have the word
+        const auto it = stats->document_freqs.find(word);
+        if (it != stats->document_freqs.end() && it->second > 0) {
+            return ComputeInverseDocumentFreq(stats->document_count, it->second);
+        }
+    }
+    return ComputeWordInverseDocumentFreq(replica, term_id);
+}
+
+double SearchServer::ComputeAverageWordCount(const IndexReplica& replica, const CollectionStats* stats) {
+    if (stats && stats->document_count > 0 && stats->word_count > 0) {
+        return stats->word_count * 1.0 / stats->document_count;
+    }
+    const size_t document_count = replica.document_ordinals.size();
+    return document_count > 0 ? replica.word_count * 1.0 / document_count : 0.0;
+}
+
+void SearchServer::FindBatchDocuments(const IndexReplica& replica, const vector<Query>& queries, DocumentStatus status,
+    size_t max_count, vector<vector<Document>>& query_documents) const {
+    const InvertedIndex& index = replica.word_to_document_freqs;
+    // Distinct words of the batch present in the index, with their term ids and
+    // inverse document frequencies; words map to -1 if absent
+    unordered_map<string_view, int> word_to_term;
+    vector<pair<int, double>> terms;
+    const auto find_term = [&](string_view word) {
+        const auto [it, is_new] = word_to_term.emplace(word, -1);
+        if (is_new) {
+            const int term_id = index.FindTerm(word);
+            if (term_id != TermDictionary::NO_TERM) {
+                it->second = static_cast<int>(terms.size());
+                terms.emplace_back(term_id, ComputeWordInverseDocumentFreq(replica, term_id));
+            }
+        }
+        return it->second;
+    };
+    // Batch terms of every query
+    vector<pair<vector<int>, vector<int>>> query_terms(queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        for (const string_view word : queries[i].plus_words) {
+            if (const int term = find_term(word); term >= 0) {
+                query_terms[i].first.push_back(term);
+            }
+        }
+        for (const string_view word : queries[i].minus_words) {
+            if (const int term = find_term(word); term >= 0) {
+                query_terms[i].second.push_back(term);
+            }
+        }
+    }
+
+    // Posting list of batch term t in segment s is at s * terms.size() + t
+    const size_t segment_count = index.GetSegmentCount();
+    vector<const PostingList*> segment_postings(segment_count * terms.size());
+    for (size_t s = 0; s < segment_count; ++s) {
+        const IndexSegment& segment = index.GetSegment(s);
+        for (size_t t = 0; t < terms.size(); ++t) {
+            segment_postings[s * terms.size() + t] = segment.Find(terms[t].first);
+        }
+    }
+
+    // Queries with the most plus-word postings are started first, so the last
+    // ones to finish are short
+    vector<pair<size_t, size_t>> costs;
+    costs.reserve(queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        size_t cost = 0;
+        for (size_t s = 0; s < segment_count; ++s) {
+            for (const int term : query_terms[i].first) {
+                if (const PostingList* postings = segment_postings[s * terms.size() + term]) {
+                    cost += postings->Size();
+                }
+            }
+        }
+        costs.emplace_back(cost, i);
+    }
+    sort(costs.begin(), costs.end(), greater<>());
+
+    vector<uint64_t> bitmap_buffer;
+    const BitmapFilter document_filter = MakeBitmapFilter(replica, DocumentFilter::ForStatus(status), bitmap_buffer);
+    const double average_word_count = ComputeAverageWordCount(replica, nullptr);
+    thread_pool_->ParallelFor(costs.size(), [&](size_t k) {
+        const size_t i = costs[k].second;
+        vector<QueryTerms> segment_terms(segment_count);
+        for (size_t s = 0; s < segment_count; ++s) {
+            segment_terms[s].average_word_count = average_word_count;
+            const PostingList* const* postings = segment_postings.data() + s * terms.size();
+            for (const int term : query_terms[i].first) {
+                if (postings[term]) {
+                    segment_terms[s].plus_terms.push_back({ postings[term], terms[term].second });
+                }
+            }
+            for (const int term : query_terms[i].second) {
+                if (postings[term]) {
+                    segment_terms[s].minus_postings.push_back(postings[term]);
+                }
+            }
+        }
+        PositionalTerms positional_terms;
+        if (!FindPositionalTerms(replica, queries[i], positional_terms)) {
+            query_documents[i].clear();
+        }
+        else if (positional_terms.Empty()) {
+            query_documents[i] = FindAllDocuments(std::execution::seq, replica, segment_terms, document_filter, max_count).Build();
+        }
+        else {
+            const PositionalFilter<BitmapFilter> positional_filter{ document_filter, replica, positional_terms };
+            query_documents[i] = FindAllDocuments(std::execution::seq, replica, segment_terms, positional_filter, max_count).Build();
+        }
+    });
+}
+
+SearchServer::BitmapFilter SearchServer::MakeBitmapFilter(const IndexReplica& replica, const DocumentFilter& filter, vector<uint64_t>& buffer) {
+    const DocumentColumns& columns = replica.document_columns;
+    return { columns.GetStatusBitmap(filter.status_mask, buffer), columns.GetRatings(), filter.min_rating, filter.max_rating };
+}
+
+bool SearchServer::FindPositionalTerms(const IndexReplica& replica, const Query& query, PositionalTerms& positional_terms) {
+    const InvertedIndex& index = replica.word_to_document_freqs;
+    positional_terms.phrases.reserve(query.phrases.size());
+    for (const QueryPhrase& phrase : query.phrases) {
+        PhraseTerms& phrase_terms = positional_terms.phrases.emplace_back();
+        for (const auto& [word, offset] : phrase.words) {
+            const int term_id = index.FindTerm(word);
+            if (term_id == TermDictionary::NO_TERM) {
+                return false;
+            }
+            phrase_terms.term_ids.push_back(term_id);
+            phrase_terms.offsets.push_back(offset);
+        }
+    }
+    positional_terms.proximities.reserve(query.proximities.size());
+    for (const QueryProximity& proximity : query.proximities) {
+        const int first_term_id = index.FindTerm(proximity.first);
+        const int second_term_id = index.FindTerm(proximity.second);
+        if (first_term_id == TermDictionary::NO_TERM || second_term_id == TermDictionary::NO_TERM) {
+            return false;
+        }
+        positional_terms.proximities.push_back({ first_term_id, second_term_id, proximity.max_distance });
+    }
+    return true;
+}
+
+bool SearchServer::HasPositionalTerms(const IndexReplica& replica, const PositionalTerms& positional_terms, int ordinal,
+    vector<vector<uint32_t>>& positions) {
+    if (positional_terms.Empty()) {
+        return true;
+    }
+    const TermFreqRange term_freqs = replica.documents[ordinal].GetTermFreqs();
+    const DocumentPositions& document_positions = *replica.document_positions[ordinal];
+    // Returns false if the document does not have the term
+    const auto decode = [&](int term_id, vector<uint32_t>& term_positions) {
+        const TermFreq* const term_freq = term_freqs.Find(term_id);
+        if (!term_freq) {
+            return false;
+        }
+        document_positions.Decode(term_freq - term_freqs.begin(), term_positions);
+        return true;
+    };
+
+    for (const PhraseTerms& phrase : positional_terms.phrases) {
+        positions.resize(phrase.term_ids.size());
+        for (size_t i = 0; i < phrase.term_ids.size(); ++i) {
+            if (!decode(phrase.term_ids[i], positions[i])) {
+                return false;
+            }
+        }
+        if (!HasPhrase(positions, phrase.offsets)) {
+            return false;
+        }
+    }
+    if (positions.size() < 2) {
+        positions.resize(2);
+    }
+    for (const ProximityTerms& proximity : positional_terms.proximities) {
+        if (!decode(proximity.first_term_id, positions[0]) || !decode(proximity.second_term_id, positions[1])
+            || !HasProximity(positions[0], positions[1], proximity.max_distance)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+SearchServer::QueryTermIds SearchServer::FindQueryTermIds(const IndexReplica& replica, const Query& query, const CollectionStats* stats) const {
+    QueryTermIds term_ids;
+    term_ids.average_word_count = ComputeAverageWordCount(replica, stats);
+    for (string_view word : query.plus_words) {
+        const int term_id = replica.word_to_document_freqs.FindTerm(word);
+        if (term_id != TermDictionary::NO_TERM) {
+            term_ids.plus_terms.emplace_back(term_id, ComputeWordInverseDocumentFreq(replica, term_id, word, stats));
+        }
+    }
+    for (string_view word : query.minus_words) {
+        const int term_id = replica.word_to_document_freqs.FindTerm(word);
+        if (term_id != TermDictionary::NO_TERM) {
+            term_ids.minus_terms.push_back(term_id);
+        }
+    }
+    return term_ids;
+}
+
+SearchServer::QueryTerms SearchServer::FindSegmentTerms(const QueryTermIds& term_ids, const IndexSegment& segment) {
+    QueryTerms terms;
+    terms.average_word_count = term_ids.average_word_count;
+    for (const auto& [term_id, inverse_document_freq] : term_ids.plus_terms) {
+        if (const PostingList* postings = segment.Find(term_id)) {
+            terms.plus_terms.push_back({ postings, inverse_document_freq });
+        }
+    }
+    for (const int term_id : term_ids.minus_terms) {
+        if (const PostingList* postings = segment.Find(term_id)) {
+            terms.minus_postings.push_back(postings);
+        }
+    }
+    return terms;
+}
+
+vector<SearchServer::QueryTerms> SearchServer::FindSegmentTerms(const IndexReplica& replica, const QueryTermIds& term_ids) {
+    const InvertedIndex& index = replica.word_to_document_freqs;
+    vector<QueryTerms> segment_terms;
+    segment_terms.reserve(index.GetSegmentCount());
+    for (size_t i = 0; i < index.GetSegmentCount(); ++i) {
+        segment_terms.push_back(FindSegmentTerms(term_ids, index.GetSegment(i)));
+    }
+    return segment_terms;
+}
+
+bool SearchServer::IsEvaluatedByImpact(const QueryTerms& terms) const {
+    return query_evaluation_ == QueryEvaluation::MAX_SCORE
+        && !terms.plus_terms.empty() && terms.plus_terms.size() <= MAX_IMPACT_ORDERED_TERMS
+        && all_of(terms.plus_terms.begin(), terms.plus_terms.end(), [](const ScoringTerm& term) {
+            return !term.postings->GetImpacts().empty();
+        });
+}
+
+void SearchServer::WaitForReaders(size_t replica_index) const {
+    while (reader_counts_[replica_index].load() > 0) {
+        this_thread::yield();
+    }
+}
+
+void SearchServer::RemoveDocumentData(IndexReplica& replica, int document_id, int ordinal) {
+    replica.document_ordinals.erase(document_id);
+    replica.word_count -= replica.documents[ordinal].word_count;
+    replica.document_columns.Remove(ordinal);
+    replica.documents[ordinal].term_freqs.reset();
+    replica.documents[ordinal].term_count = 0;
+    if (!replica.document_positions.empty()) {
+        replica.document_positions[ordinal].reset();
+    }
+}
+
+void SearchServer::MarkDocumentRemoved(IndexReplica& replica, int document_id, int ordinal) {
+    for (const auto& [term_id, term_freq] : replica.documents[ordinal].GetTermFreqs()) {
+        replica.word_to_document_freqs.MarkRemoved(term_id);
+    }
+    replica.word_to_document_freqs.MarkDocumentRemoved(ordinal);
+    replica.is_removed[ordinal] = true;
+    RemoveDocumentData(replica, document_id, ordinal);
+}
+
+void SearchServer::SealMutableSegmentIfNeeded(IndexReplica& replica) const {
+    InvertedIndex& index = replica.word_to_document_freqs;
+    if (index.GetSegment(index.GetSegmentCount() - 1).GetDocumentCount() >= segment_size_) {
+        index.SealMutableSegment(static_cast<int>(replica.documents.size()));
+    }
+}
+
+void SearchServer::StartMergesIfNeeded() {
+    if (is_merging_ || merge_pause_count_ > 0 || PlanMerge().count == 0) {
+        return;
+    }
+    is_merging_ = true;
+    // A dedicated thread: a pool worker waiting for the readers of a replica could
+    // be the very thread that reads it while helping with a parallel query
+    merges_ = async(launch::async, [this] {
+        MergeSegments();
+    });
+}
+
+void SearchServer::PauseMerges(unique_lock<mutex>& lock) {
+    ++merge_pause_count_;
+    merges_finished_.wait(lock, [this] {
+        return !is_merging_;
+    });
+}
+
+void SearchServer::ResumeMerges() {
+    --merge_pause_count_;
+    StartMergesIfNeeded();
+}
+
+SearchServer::SegmentRange SearchServer::PlanMerge() const {
+    const InvertedIndex& index = replicas_[0]->word_to_document_freqs;
+    const size_t sealed_count = index.GetSegmentCount() - 1;
+    for (size_t i = 0; i < sealed_count; ++i) {
+        const size_t removed_count = index.GetRemovedCount(i);
+        if (removed_count > 0 && removed_count >= compaction_threshold_ * index.GetSegment(i).GetDocumentCount()) {
+            return { i, 1 };
+        }
+    }
+    // Merging only segments not larger than their predecessors keeps the
+    // segment count logarithmic, every document being rewritten O(log n) times
+    const auto live_count = [&index](size_t i) {
+        return index.GetSegment(i).GetDocumentCount() - index.GetRemovedCount(i);
+    };
+    for (size_t i = 0; i + 1 < sealed_count; ++i) {
+        if (live_count(i + 1) >= live_count(i)) {
+            return { i, 2 };
+        }
+    }
+    return {};
+}
+
+void SearchServer::MergeSegments() {
+    while (true) {
+        SegmentRange range;
+        vector<shared_ptr<const IndexSegment>> segments;
+        vector<bool> is_removed;
+        PostingListEncoding encoding;
+        bool has_impact_order = false;
+        {
+            lock_guard guard(writer_mutex_);
+            range = merge_pause_count_ > 0 ? SegmentRange{} : PlanMerge();
+            if (range.count == 0) {
+                is_merging_ = false;
+                merges_finished_.notify_all();
+                return;
+            }
+            // Replicas share their sealed segments
+            const IndexReplica& replica = *replicas_[0];
+            for (size_t i = range.first; i < range.first + range.count; ++i) {
+                segments.push_back(replica.word_to_document_freqs.ShareSegment(i));
+            }
+            is_removed.assign(replica.is_removed.begin() + segments.front()->GetBegin(), replica.is_removed.begin() + segments.back()->GetEnd());
+            encoding = replica.word_to_document_freqs.GetEncoding();
+            has_impact_order = replica.word_to_document_freqs.HasImpactOrder();
+        }
+
+        // Sealed segments are immutable, so the merge runs while queries and additions go on
+        const auto merged = make_shared<IndexSegment>(IndexSegment::Merge(segments, is_removed, encoding, has_impact_order));
+        const size_t purged_count = count(is_removed.begin(), is_removed.end(), true);
+
+        lock_guard guard(writer_mutex_);
+        ModifyReplicas([&](IndexReplica& replica) {
+            replica.word_to_document_freqs.ReplaceSegments(range.first, range.count, merged, purged_count);
+            for (size_t i = 0; i < is_removed.size(); ++i) {
+                if (is_removed[i]) {
+                    replica.is_removed[merged->GetBegin() + i] = false;
+                }
+            }
+        });
+    }
+}
@@ -1,46 +1,139 @@
 #pragma once
 
-#include "concurrent_map.h"
 #include "document.h"
+#include "document_columns.h"
+#include "document_positions.h"
+#include "index_snapshot.h"
+#include "inverted_index.h"
 #include "log_duration.h"
+#include "query_cache.h"
+#include "query_results.h"
+#include "ranking.h"
 #include "read_input_functions.h"
 #include "string_processing.h"
+#include "thread_pool.h"
+#include "top_documents.h"
+#include "word_set.h"
+#include "write_ahead_log.h"
 
 #include <algorithm>
+#include <array>
 #include <atomic>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
 #include <execution>
 #include <future>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <numeric>
 #include <set>
+#include <shared_mutex>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+enum class QueryEvaluation {
+    // Scores every posting of every plus-word
+    EXHAUSTIVE,
+    // Document-at-a-time MaxScore: skips documents whose best possible
+    // relevance cannot enter the current top results
+    MAX_SCORE,
+};
+
+enum class RemovalMode {
+    // RemoveDocument erases the postings of a document in the mutable segment
+    // right away; documents of sealed segments are marked removed
+    IMMEDIATE,
+    // RemoveDocument only marks the document removed; its postings are
+    // purged when a background merge rewrites its segment
+    DEFERRED,
+};
+
+enum class ReadConcurrency {
+    // Queries lock the index shared; modifications wait for the running
+    // queries and hold off new ones meanwhile
+    LOCKING,
+    // Queries never lock: they read one of two replicas of the index while a
+    // modification is applied to the other one, which readers then switch to
+    // before the first replica catches up. Sealed segments are shared between
+    // the replicas, everything else takes twice the memory and the time to modify
+    LOCK_FREE,
+};
+
+// Statistics of a document collection that inverse document frequencies are
+// computed from, e.g. of all the shards of a sharded index
+struct CollectionStats {
+    int document_count = 0;
+    // Words of all the documents, which BM25 averages over document_count
+    uint64_t word_count = 0;
+    // Documents having each plus-word of a query
+    std::map<std::string_view, int> document_freqs;
+};
+
+// Documents are indexed into a mutable segment, which is sealed once it holds
+// SetSegmentSize documents. Sealed segments are never modified: a background
+// thread merges them and purges removed documents, and queries score every
+// segment into one top-K accumulator. Modifications are serialized and may
+// run concurrently with const member functions, except for begin and end.
 class SearchServer {
 public:
     template <typename StringContainer>
     explicit SearchServer(const StringContainer& stop_words);
     explicit SearchServer(const std::string& stop_words_view);
     explicit SearchServer(std::string_view stop_words_view);
+    // Serves the posting lists right from the mapped snapshot; a list is copied
+    // to memory only when added or removed documents modify it
+    explicit SearchServer(std::shared_ptr<const IndexSnapshot> snapshot);
+    ~SearchServer();
 
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+    // Adds a batch of documents: ranges of the batch are tokenized into partial
+    // indexes (in parallel for the parallel policy), which are then merged into
+    // every affected posting list at once. Nothing is added if any document is invalid
+    template <typename ExecutionPolicy>
+    void AddDocuments(const ExecutionPolicy& policy, const std::vector<NewDocument>& documents);
+    void AddDocuments(const std::vector<NewDocument>& documents);
+
+    // Queries are words separated by spaces; -word excludes the documents having
+    // the word. With the positional index "quoted words" must occur as a phrase
+    // and a NEAR/k b within k positions of each other in the documents found.
+    // A DocumentFilter as the predicate is checked on status bitmaps before
+    // scoring, any other predicate is called for every scored document
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
     std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
+    template<typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate, size_t max_count) const;
+    template<typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status, size_t max_count) const;
     template<typename ExecutionPolicy, typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
     template<typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status) const;
     template<typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query) const;
+    // Computes inverse document frequencies from stats instead of this index;
+    // the results are not cached
+    template<typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate, size_t max_count, const CollectionStats& stats) const;
+    // Adds the documents of this index to stats, which then views the words of raw_query
+    void AddCollectionStats(std::string_view raw_query, CollectionStats& stats) const;
+
+    // Runs a batch of queries on one replica of the index. Identical queries run
+    // once, every distinct word is looked up once, and queries are spread over the
+    // thread pool most expensive first. The cache is not used
+    QueryResults FindTopDocumentsBatch(const std::vector<std::string>& raw_queries, DocumentStatus status, size_t max_count) const;
 
     int GetDocumentCount() const;
 
@@ -51,23 +144,170 @@ public:
     std::set<int>::const_iterator begin() const;
     std::set<int>::const_iterator end() const;
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // Words point into the term dictionary and stay valid while the server exists
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
 
     template<typename ExecutionPolicy>
     void RemoveDocument(const ExecutionPolicy& policy, int document_id);
     void RemoveDocument(int document_id);
 
+    // Removes a range of document ids rewriting every affected posting list once
+    template<typename ExecutionPolicy, typename DocumentIds>
+    void RemoveDocuments(const ExecutionPolicy& policy, const DocumentIds& document_ids);
+    template<typename DocumentIds>
+    void RemoveDocuments(const DocumentIds& document_ids);
+
+    void SetPostingListEncoding(PostingListEncoding encoding);
+    // Keeps the postings of sealed segments also ordered by term frequency, so
+    // MAX_SCORE queries of up to MAX_IMPACT_ORDERED_TERMS plus-words stop reading
+    // them once no further document can enter the results; off by default
+    void SetImpactOrder(bool has_impact_order);
+    // Records word positions of the documents, which phrase and NEAR/k queries
+    // need; stop words take positions too. Must be turned on before the first
+    // document is added. Off by default, which stores no positions. Snapshots
+    // keep the positions, so a server restored from a positional one is positional
+    void SetPositionalIndex(bool is_positional);
+    // Evaluation strategy of queries, MAX_SCORE by default
+    void SetQueryEvaluation(QueryEvaluation evaluation);
+    // TF_IDF by default; must not be called concurrently with queries
+    void SetRankingFunction(RankingFunction ranking_function);
+    // Number of document ranges a parallel query is split into,
+    // the number of hardware threads by default
+    void SetWorkerCount(size_t worker_count);
+
+    // Pool running all parallel operations, ThreadPool::GetDefault() unless replaced
+    void SetThreadPool(std::shared_ptr<ThreadPool> thread_pool);
+    ThreadPool& GetThreadPool() const;
+
+    // IMMEDIATE by default
+    void SetRemovalMode(RemovalMode mode);
+    // Share of removed documents in a sealed segment that makes a merge rewrite it
+    void SetCompactionThreshold(double removed_share);
+    // Documents the mutable segment takes before it is sealed
+    void SetSegmentSize(size_t document_count);
+    // Blocks until the running merges, if any, are finished
+    void WaitForMerges();
+    // LOCKING by default; must not be called concurrently with queries
+    void SetReadConcurrency(ReadConcurrency concurrency);
+    // Caches the results of up to capacity queries by status, 0 (the default)
+    // disables the cache; must not be called concurrently with queries
+    void SetQueryCacheCapacity(size_t capacity);
+    QueryCacheStats GetQueryCacheStats() const;
+
+    // Writes stop words, terms, plain posting lists and documents to a file that
+    // IndexSnapshot maps. Removed documents are left out and ordinals renumbered
+    void SaveSnapshot(const std::string& path) const;
+    // Valid additions and removals are logged before they are applied and
+    // return once their records are synced, which happens after writer_mutex_
+    // is released, so concurrent writers share syncs. A failed sync throws
+    // with the modification applied but not durable. nullptr detaches the log
+    void SetWriteAheadLog(std::shared_ptr<WriteAheadLog> write_ahead_log);
+
 private:
+    // Term ids of a document with their term frequencies, ordered by term id
+    using TermFreqs = std::vector<TermFreq>;
+    struct TermFreqRange {
+        const TermFreq* data;
+        size_t count;
+
+        const TermFreq* begin() const {
+            return data;
+        }
+        const TermFreq* end() const {
+            return data + count;
+        }
+        size_t size() const {
+            return count;
+        }
+        const TermFreq& operator[](size_t i) const {
+            return data[i];
+        }
+        // Returns nullptr if the document does not have the term
+        const TermFreq* Find(int term_id) const {
+            const TermFreq* const it = std::lower_bound(begin(), end(), term_id, [](const TermFreq& term_freq, int id) {
+                return term_freq.term_id < id;
+            });
+            return it != end() && it->term_id == term_id ? it : nullptr;
+        }
+    };
     struct DocumentData {
-        int rating;
-        DocumentStatus status;
-        std::set<std::string, std::less<>> words;
+        int id;
+        // Words that are not stop words
+        uint32_t word_count;
+        // First of term_count forward index entries, owned by TermFreqs the replicas
+        // share or mapped from the snapshot; reset when the document is removed
+        std::shared_ptr<const TermFreq> term_freqs;
+        uint32_t term_count;
+
+        TermFreqRange GetTermFreqs() const {
+            return { term_freqs.get(), term_count };
+        }
+    };
+    // State queries read, modified only through ModifyReplicas
+    struct IndexReplica {
+        // Posting lists hold dense document ordinals instead of document ids
+        InvertedIndex word_to_document_freqs;
+        // Indexed by ordinal, also serves as the forward index; ordinals of removed
+        // documents are not reused
+        std::vector<DocumentData> documents;
+        std::unordered_map<int, int> document_ordinals;
+        // Indexed by ordinal, marks removed documents whose postings are still in a segment
+        std::vector<bool> is_removed;
+        // Statuses and ratings indexed like documents
+        DocumentColumns document_columns;
+        // Indexed like documents, empty unless the positional index is on;
+        // shared by the replicas, reset when the document is removed
+        std::vector<std::shared_ptr<const DocumentPositions>> document_positions;
+        // Sum of word_count over the documents that are not removed
+        uint64_t word_count = 0;
     };
+    // Postings of a word in a range of an AddDocuments batch, in ascending ordinal order
+    using RangePostings = std::vector<std::pair<int, double>>;
+    using PartialIndex = std::unordered_map<std::string_view, RangePostings>;
+    // Relevance accumulated for a document no plus-word matched
+    static constexpr double NOT_MATCHED = -1.0;
+    // Every document found in the impact order costs a lookup in the other
+    // plus-words, which pays off for few of them only
+    static constexpr size_t MAX_IMPACT_ORDERED_TERMS = 3;
+
+    // Outlives the posting lists mapped from it
+    std::shared_ptr<const IndexSnapshot> snapshot_;
     std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
-    std::map<int, DocumentData> documents_;
+    // The second replica exists in the LOCK_FREE mode only
+    std::array<std::unique_ptr<IndexReplica>, 2> replicas_ = { std::make_unique<IndexReplica>() };
+    ReadConcurrency read_concurrency_ = ReadConcurrency::LOCKING;
+    // Replica new LOCK_FREE readers take and the number of readers of each replica
+    std::atomic<size_t> read_index_ = 0;
+    mutable std::array<std::atomic<size_t>, 2> reader_counts_ = {};
     std::set<int> document_ids_;
+    QueryEvaluation query_evaluation_ = QueryEvaluation::MAX_SCORE;
+    RankingFunction ranking_function_ = RankingFunction::TF_IDF;
+    bool is_positional_ = false;
+    size_t worker_count_ = std::max(1u, std::thread::hardware_concurrency());
+    std::shared_ptr<ThreadPool> thread_pool_ = ThreadPool::GetDefault();
+
+    RemovalMode removal_mode_ = RemovalMode::IMMEDIATE;
+    double compaction_threshold_ = 0.2;
+    size_t segment_size_ = 16384;
+    // Serializes modifications and segment replacements by the merge thread
+    std::mutex writer_mutex_;
+    // In the LOCKING mode queries lock it shared, replica modifications exclusively
+    mutable std::shared_mutex index_mutex_;
+    // Taken before index_mutex_ and held by a modification until it has locked
+    // the index, so queries arriving meanwhile wait instead of starving it;
+    // shared_mutex itself may prefer readers
+    mutable std::mutex index_gate_mutex_;
+    // The merge state below is guarded by writer_mutex_
+    bool is_merging_ = false;
+    // No merge starts while positive
+    size_t merge_pause_count_ = 0;
+    // Notified when is_merging_ turns false
+    std::condition_variable merges_finished_;
+    std::future<void> merges_;
+    std::shared_ptr<WriteAheadLog> write_ahead_log_;
+    // Bumped once a modification that changes query results is applied to every replica
+    std::atomic<uint64_t> generation_ = 0;
+    std::unique_ptr<QueryCache> query_cache_;
 
     bool IsStopWord(std::string_view word) const;
 
@@ -77,27 +317,231 @@ private:
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
+    struct DocumentWords {
+        // Words are views into the text
+        std::map<std::string_view, double> word_freqs;
+        uint32_t word_count = 0;
+        // Filled with the positional index on only
+        std::map<std::string_view, std::vector<uint32_t>> word_positions;
+    };
+
+    DocumentWords ComputeWordFreqs(std::string_view text) const;
+    // Sorts by term id, which is unique in a document
+    static void SortTermFreqs(TermFreqs& term_freqs);
+    static DocumentData MakeDocumentData(int id, uint32_t word_count, const std::shared_ptr<const TermFreqs>& term_freqs);
+    // Positions of the words of term_freqs in its order
+    static std::shared_ptr<const DocumentPositions> MakeDocumentPositions(const TermFreqs& term_freqs, const TermDictionary& terms,
+        const std::map<std::string_view, std::vector<uint32_t>>& word_positions);
+    // Throws invalid_argument if an id is negative, already added or repeated in the batch
+    void CheckNewDocumentIds(const std::vector<NewDocument>& documents) const;
+    void WriteSnapshot(const IndexReplica& replica, const std::string& path) const;
+    // Points the documents of the replica at the positions of the snapshot and
+    // turns the positional index on; throws invalid_argument if they are corrupted
+    void ReadPositions(const SnapshotHeader& header, IndexReplica& replica);
+    // Appends documents indexed with ordinals starting at replica.documents.size()
+    // positions is empty unless the positional index is on
+    void AddIndexedDocuments(IndexReplica& replica, const std::vector<NewDocument>& documents, const std::vector<uint32_t>& word_counts,
+        const std::vector<std::shared_ptr<const TermFreqs>>& term_freqs, const std::vector<std::shared_ptr<const DocumentPositions>>& positions) const;
+
     struct QueryWord {
         std::string_view data;
         bool is_minus;
         bool is_stop;
     };
 
-    QueryWord ParseQueryWord(std::string_view text) const;
+    // is_valid tells if the text has no control characters
+    QueryWord ParseQueryWord(std::string_view text, bool is_valid) const;
+
+    // Words of a quoted phrase with their offsets from the first one
+    struct QueryPhrase {
+        std::vector<std::pair<std::string_view, uint32_t>> words;
+    };
+
+    // Words of a NEAR/max_distance, in any order in documents
+    struct QueryProximity {
+        std::string_view first;
+        std::string_view second;
+        uint32_t max_distance;
+    };
 
     struct Query {
-        std::set<std::string_view> plus_words;
-        std::set<std::string_view> minus_words;
+        // Views into the raw query, small queries are parsed without allocations
+        WordSet plus_words;
+        WordSet minus_words;
+        // Required of every document found; their words are plus-words too
+        std::vector<QueryPhrase> phrases;
+        std::vector<QueryProximity> proximities;
     };
 
+    // Phrases and NEAR/k are only recognized with the positional index on; without
+    // it quotes and NEAR/k are parsed as parts of words, as in any other query
     Query ParseQuery(std::string_view text) const;
+    // Words are sorted and unique in the query, so equal queries make equal keys
+    static std::string MakeQueryCacheKey(const Query& query, DocumentStatus status, size_t max_count);
 
-    double ComputeWordInverseDocumentFreq(std::string_view word) const;
+    double ComputeInverseDocumentFreq(int document_count, int document_freq) const;
+    double ComputeWordInverseDocumentFreq(const IndexReplica& replica, int term_id) const;
+    // Falls back to the replica for a word stats do not have
+    double ComputeWordInverseDocumentFreq(const IndexReplica& replica, int term_id, std::string_view word, const CollectionStats* stats) const;
+    static double ComputeAverageWordCount(const IndexReplica& replica, const CollectionStats* stats);
+
+    // Term ids of the query words present in the index
+    struct QueryTermIds {
+        // Term id and inverse document frequency
+        std::vector<std::pair<int, double>> plus_terms;
+        std::vector<int> minus_terms;
+        double average_word_count = 0.0;
+    };
+
+    struct ScoringTerm {
+        const PostingList* postings;
+        double inverse_document_freq;
+    };
+
+    // Posting lists of the query terms in one segment
+    struct QueryTerms {
+        std::vector<ScoringTerm> plus_terms;
+        std::vector<const PostingList*> minus_postings;
+        // Average document length the ranking function normalizes by
+        double average_word_count = 0.0;
+    };
+
+    // Phrases and NEAR/k of a query with term ids
+    struct PhraseTerms {
+        std::vector<int> term_ids;
+        std::vector<uint32_t> offsets;
+    };
+
+    struct ProximityTerms {
+        int first_term_id;
+        int second_term_id;
+        uint32_t max_distance;
+    };
+
+    struct PositionalTerms {
+        std::vector<PhraseTerms> phrases;
+        std::vector<ProximityTerms> proximities;
+
+        bool Empty() const {
+            return phrases.empty() && proximities.empty();
+        }
+    };
+
+    // Returns false if a word of a phrase or NEAR/k is in no document, so nothing matches
+    static bool FindPositionalTerms(const IndexReplica& replica, const Query& query, PositionalTerms& positional_terms);
+    // Tells if the document, which must not be removed, has the phrases and proximities,
+    // which always holds without any; decodes into positions
+    static bool HasPositionalTerms(const IndexReplica& replica, const PositionalTerms& positional_terms, int ordinal,
+        std::vector<std::vector<uint32_t>>& positions);
+
+    // Inverse document frequencies come from stats unless it is nullptr
+    QueryTermIds FindQueryTermIds(const IndexReplica& replica, const Query& query, const CollectionStats* stats) const;
+    static QueryTerms FindSegmentTerms(const QueryTermIds& term_ids, const IndexSegment& segment);
+    static std::vector<QueryTerms> FindSegmentTerms(const IndexReplica& replica, const QueryTermIds& term_ids);
+    // Writes the results of queries[i] to query_documents[i]
+    void FindBatchDocuments(const IndexReplica& replica, const std::vector<Query>& queries, DocumentStatus status,
+        size_t max_count, std::vector<std::vector<Document>>& query_documents) const;
+
+    // Sealed segments [first, first + count) to merge
+    struct SegmentRange {
+        size_t first = 0;
+        size_t count = 0;
+    };
+
+    // Calls function(replica) with a replica no modification is applied to meanwhile
+    template <typename Function>
+    auto ReadReplica(Function function) const;
+    // Calls function(replica) for every replica, so the function must modify them
+    // the same way; takes writer_mutex_ held
+    template <typename Function>
+    void ModifyReplicas(Function function);
+    void WaitForReaders(size_t replica_index) const;
+
+    // Drops everything but the postings of a document
+    static void RemoveDocumentData(IndexReplica& replica, int document_id, int ordinal);
+    static void MarkDocumentRemoved(IndexReplica& replica, int document_id, int ordinal);
+    void SealMutableSegmentIfNeeded(IndexReplica& replica) const;
+    // All three take writer_mutex_ held
+    void StartMergesIfNeeded();
+    // Keeps new merges from starting and waits for the running one, releasing
+    // the lock meanwhile; ResumeMerges undoes it
+    void PauseMerges(std::unique_lock<std::mutex>& lock);
+    void ResumeMerges();
+    // Rewrites a segment with enough removed documents, otherwise merges a pair
+    // of adjacent segments where the later one is not smaller; count is 0 if none
+    SegmentRange PlanMerge() const;
+    // Merges segments until none is planned, holding writer_mutex_ only to take
+    // the segments and to replace them with the merged one
+    void MergeSegments();
+
+    // Ordinal filters tell if the document of an ordinal is not removed and is accepted
+    struct BitmapFilter {
+        const uint64_t* status_bitmap;
+        const int* ratings;
+        int min_rating;
+        int max_rating;
+
+        bool operator()(int ordinal) const {
+            return (status_bitmap[ordinal / 64] >> (ordinal % 64) & 1) != 0
+                && ratings[ordinal] >= min_rating && ratings[ordinal] <= max_rating;
+        }
+    };
 
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate) const;
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy&, const Query& query, DocumentPredicate document_predicate) const;
+    struct PredicateFilter {
+        const IndexReplica& replica;
+        const DocumentPredicate& document_predicate;
+
+        bool operator()(int ordinal) const {
+            const DocumentColumns& columns = replica.document_columns;
+            return !replica.is_removed[ordinal]
+                && document_predicate(replica.documents[ordinal].id, columns.GetStatus(ordinal), columns.GetRating(ordinal));
+        }
+    };
+
+    // Checks phrases and proximities of documents the wrapped filter accepts.
+    // Every copy decodes into buffers of its own
+    template <typename OrdinalFilter>
+    struct PositionalFilter {
+        OrdinalFilter ordinal_filter;
+        const IndexReplica& replica;
+        const PositionalTerms& positional_terms;
+        mutable std::vector<std::vector<uint32_t>> positions = {};
+
+        bool operator()(int ordinal) const {
+            return ordinal_filter(ordinal) && HasPositionalTerms(replica, positional_terms, ordinal, positions);
+        }
+    };
+
+    // Status bitmaps of several statuses are combined into buffer
+    static BitmapFilter MakeBitmapFilter(const IndexReplica& replica, const DocumentFilter& filter, std::vector<uint64_t>& buffer);
+
+    // Calls function(i) for every i in [0, count), on the thread pool for the parallel policy
+    template <typename ExecutionPolicy, typename Function>
+    void ForEachIndex(const ExecutionPolicy& policy, size_t count, Function function) const;
+
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindQueryDocuments(const ExecutionPolicy& policy, const Query& query, DocumentPredicate document_predicate, size_t max_count, const CollectionStats* stats = nullptr) const;
+    // segment_terms holds the query terms of every segment of the replica
+    template <typename OrdinalFilter>
+    TopDocuments FindAllDocuments(const std::execution::parallel_policy&, const IndexReplica& replica, const std::vector<QueryTerms>& segment_terms, OrdinalFilter ordinal_filter, size_t max_count) const;
+    template <typename OrdinalFilter>
+    TopDocuments FindAllDocuments(const std::execution::sequenced_policy&, const IndexReplica& replica, const std::vector<QueryTerms>& segment_terms, OrdinalFilter ordinal_filter, size_t max_count) const;
+    // Tells if the terms of a segment are evaluated in the impact order, which
+    // reads whole posting lists whatever range of ordinals is scored
+    bool IsEvaluatedByImpact(const QueryTerms& terms) const;
+    // Scores matching documents with ordinals in [begin, end) of one segment into top_documents
+    template <typename OrdinalFilter>
+    void FindDocumentsInRange(const IndexReplica& replica, const QueryTerms& terms, OrdinalFilter ordinal_filter, TopDocuments& top_documents, int begin, int end) const;
+    template <typename Ranking, typename OrdinalFilter>
+    void FindRankedDocumentsInRange(const Ranking& ranking, const IndexReplica& replica, const QueryTerms& terms, OrdinalFilter ordinal_filter, TopDocuments& top_documents, int begin, int end) const;
+    template <typename Ranking, typename OrdinalFilter>
+    void FindDocumentsExhaustive(const Ranking& ranking, const IndexReplica& replica, const QueryTerms& terms, OrdinalFilter ordinal_filter, TopDocuments& top_documents, int begin, int end) const;
+    template <typename Ranking, typename OrdinalFilter>
+    void FindDocumentsMaxScore(const Ranking& ranking, const IndexReplica& replica, const QueryTerms& terms, OrdinalFilter ordinal_filter, TopDocuments& top_documents, int begin, int end) const;
+    // Takes the postings of every plus-word in the impact order
+    template <typename Ranking, typename OrdinalFilter>
+    void FindDocumentsByImpact(const Ranking& ranking, const IndexReplica& replica, const QueryTerms& terms, OrdinalFilter ordinal_filter, TopDocuments& top_documents, int begin, int end) const;
 };
 
 template <typename StringContainer>
@@ -113,27 +557,132 @@ SearchServer::SearchServer(const StringContainer& stop_words) {
     }
 }
 
-template<typename ExecutionPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
-    
-    const Query query = ParseQuery(raw_query);
-    
-    std::vector<Document> matched_documents = FindAllDocuments(policy, query, document_predicate);
-    
-    std::sort(policy, matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-        if (std::abs(lhs.relevance - rhs.relevance) < 1e-6) {
-            return lhs.rating > rhs.rating;
+template <typename ExecutionPolicy>
+void SearchServer::AddDocuments(const ExecutionPolicy& policy, const std::vector<NewDocument>& documents) {
+    std::unique_lock lock(writer_mutex_);
+    CheckNewDocumentIds(documents);
+    const int first_ordinal = static_cast<int>(replicas_[0]->documents.size());
+
+    const size_t range_count = std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>
+        ? std::max<size_t>(1, std::min(worker_count_, documents.size()))
+        : 1;
+    const auto range_begin = [&documents, range_count](size_t range) {
+        return documents.size() * range / range_count;
+    };
+    std::vector<std::map<std::string_view, double>> word_freqs(documents.size());
+    std::vector<uint32_t> word_counts(documents.size());
+    std::vector<std::map<std::string_view, std::vector<uint32_t>>> word_positions(is_positional_ ? documents.size() : 0);
+    std::vector<PartialIndex> partial_indexes(range_count);
+    ForEachIndex(policy, range_count, [&](size_t range) {
+        PartialIndex& partial_index = partial_indexes[range];
+        for (size_t i = range_begin(range); i < range_begin(range + 1); ++i) {
+            DocumentWords document_words = ComputeWordFreqs(documents[i].text);
+            word_freqs[i] = std::move(document_words.word_freqs);
+            word_counts[i] = document_words.word_count;
+            if (is_positional_) {
+                word_positions[i] = std::move(document_words.word_positions);
+            }
+            for (const auto& [word, term_freq] : word_freqs[i]) {
+                partial_index[word].emplace_back(first_ordinal + static_cast<int>(i), term_freq);
+            }
         }
-        else {
-            return lhs.relevance > rhs.relevance;
+    });
+
+    const std::shared_ptr<WriteAheadLog> log = documents.empty() ? nullptr : write_ahead_log_;
+    const uint64_t log_sequence = log ? log->LogAddDocuments(documents) : 0;
+
+    // Ranges hold ascending ordinals, so every posting list appends their postings in range order
+    std::unordered_map<std::string_view, std::vector<const RangePostings*>> word_to_range_postings;
+    for (const PartialIndex& partial_index : partial_indexes) {
+        for (const auto& [word, postings] : partial_index) {
+            word_to_range_postings[word].push_back(&postings);
         }
+    }
+    // Replicas assign the same term ids, so the forward index is built once
+    std::vector<std::shared_ptr<const TermFreqs>> term_freqs;
+    std::vector<std::shared_ptr<const DocumentPositions>> positions(word_positions.size());
+    ModifyReplicas([&](IndexReplica& replica) {
+        InvertedIndex& index = replica.word_to_document_freqs;
+        std::vector<std::pair<int, const std::vector<const RangePostings*>*>> appends;
+        appends.reserve(word_to_range_postings.size());
+        for (const auto& [word, range_postings] : word_to_range_postings) {
+            appends.emplace_back(index.AddTerm(word), &range_postings);
+        }
+        for (const auto& [term_id, range_postings] : appends) {
+            index.PrepareAppend(term_id);
+        }
+        ForEachIndex(policy, appends.size(), [&index, &appends](size_t i) {
+            for (const RangePostings* range_postings : *appends[i].second) {
+                index.Append(appends[i].first, *range_postings);
+            }
         });
-    
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+
+        if (term_freqs.empty()) {
+            // No terms are added any more, so documents look their term ids up concurrently
+            term_freqs.resize(documents.size());
+            ForEachIndex(policy, range_count, [&](size_t range) {
+                const TermDictionary& terms = index.GetTerms();
+                for (size_t i = range_begin(range); i < range_begin(range + 1); ++i) {
+                    TermFreqs document_term_freqs;
+                    document_term_freqs.reserve(word_freqs[i].size());
+                    for (const auto& [word, term_freq] : word_freqs[i]) {
+                        document_term_freqs.push_back({ terms.Find(word), term_freq });
+                    }
+                    SortTermFreqs(document_term_freqs);
+                    if (is_positional_) {
+                        positions[i] = MakeDocumentPositions(document_term_freqs, terms, word_positions[i]);
+                    }
+                    term_freqs[i] = std::make_shared<const TermFreqs>(std::move(document_term_freqs));
+                }
+            });
+        }
+        AddIndexedDocuments(replica, documents, word_counts, term_freqs, positions);
+    });
+    ++generation_;
+    for (const NewDocument& document : documents) {
+        document_ids_.insert(document.id);
+    }
+    StartMergesIfNeeded();
+    lock.unlock();
+    if (log) {
+        log->Sync(log_sequence);
+    }
+}
+
+template<typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate, size_t max_count) const {
+    const Query query = ParseQuery(raw_query);
+    if (max_count == 0) {
+        return {};
+    }
+    return FindQueryDocuments(policy, query, document_predicate, max_count);
+}
+
+template<typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status, size_t max_count) const {
+    const Query query = ParseQuery(raw_query);
+    if (max_count == 0) {
+        return {};
+    }
+    const DocumentFilter document_filter = DocumentFilter::ForStatus(status);
+    if (!query_cache_) {
+        return FindQueryDocuments(policy, query, document_filter, max_count);
+    }
+
+    // Read before the index, so a result of a later modification is never cached as an earlier one
+    const uint64_t generation = generation_.load();
+    const std::string key = MakeQueryCacheKey(query, status, max_count);
+    std::vector<Document> documents;
+    if (!query_cache_->Find(key, generation, documents)) {
+        documents = FindQueryDocuments(policy, query, document_filter, max_count);
+        query_cache_->Insert(key, generation, documents);
     }
-    
-    return matched_documents;
+    return documents;
+}
+
+template<typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
+    return FindTopDocuments(policy, raw_query, document_predicate, MAX_RESULT_DOCUMENT_COUNT);
 }
 
 template <typename DocumentPredicate>
@@ -143,10 +692,7 @@ std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,
 
 template<typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(policy, raw_query,
-        [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
-        });
+    return FindTopDocuments(policy, raw_query, status, MAX_RESULT_DOCUMENT_COUNT);
 }
 
 template<typename ExecutionPolicy>
@@ -154,119 +700,526 @@ std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& poli
     return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::sequenced_policy&, const Query& query, DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(query.plus_words.size());
-    ConcurrentSet<int> bad_documents(document_ids_.size());
-
-    for (std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) != 0) {
-            for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                bad_documents.Insert(document_id);
+template<typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate, size_t max_count, const CollectionStats& stats) const {
+    const Query query = ParseQuery(raw_query);
+    if (max_count == 0) {
+        return {};
+    }
+    return FindQueryDocuments(policy, query, document_predicate, max_count, &stats);
+}
+
+template<typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindQueryDocuments(const ExecutionPolicy& policy, const Query& query, DocumentPredicate document_predicate, size_t max_count, const CollectionStats* stats) const {
+    return ReadReplica([&](const IndexReplica& replica) -> std::vector<Document> {
+        PositionalTerms positional_terms;
+        if (!FindPositionalTerms(replica, query, positional_terms)) {
+            return {};
+        }
+        const QueryTermIds term_ids = FindQueryTermIds(replica, query, stats);
+        const std::vector<QueryTerms> segment_terms = FindSegmentTerms(replica, term_ids);
+        const auto find_all_documents = [&](auto ordinal_filter) {
+            if (positional_terms.Empty()) {
+                return FindAllDocuments(policy, replica, segment_terms, ordinal_filter, max_count).Build();
             }
+            using PositionalFilterType = PositionalFilter<decltype(ordinal_filter)>;
+            return FindAllDocuments(policy, replica, segment_terms, PositionalFilterType{ ordinal_filter, replica, positional_terms }, max_count).Build();
+        };
+        if constexpr (std::is_same_v<DocumentPredicate, DocumentFilter>) {
+            std::vector<uint64_t> buffer;
+            return find_all_documents(MakeBitmapFilter(replica, document_predicate, buffer));
+        }
+        else {
+            return find_all_documents(PredicateFilter<DocumentPredicate>{ replica, document_predicate });
         }
+    });
+}
+
+template <typename OrdinalFilter>
+TopDocuments SearchServer::FindAllDocuments(const std::execution::sequenced_policy&, const IndexReplica& replica, const std::vector<QueryTerms>& segment_terms, OrdinalFilter ordinal_filter, size_t max_count) const {
+    const InvertedIndex& index = replica.word_to_document_freqs;
+    TopDocuments top_documents(max_count);
+    for (size_t i = 0; i < segment_terms.size(); ++i) {
+        const IndexSegment& segment = index.GetSegment(i);
+        FindDocumentsInRange(replica, segment_terms[i], ordinal_filter, top_documents, segment.GetBegin(), segment.GetEnd());
+    }
+    return top_documents;
+}
+
+template <typename OrdinalFilter>
+TopDocuments SearchServer::FindAllDocuments(const std::execution::parallel_policy&, const IndexReplica& replica, const std::vector<QueryTerms>& segment_terms, OrdinalFilter ordinal_filter, size_t max_count) const {
+    const InvertedIndex& index = replica.word_to_document_freqs;
+
+    // Every worker scores its own range of ordinals, so no state is shared until the merge
+    static constexpr size_t MIN_RANGE_SIZE = 1024;
+    const int document_count = static_cast<int>(replica.documents.size());
+    const size_t range_count = std::max<size_t>(1, std::min(worker_count_, replica.documents.size() / MIN_RANGE_SIZE));
+    const auto range_begin = [document_count, range_count](size_t range) {
+        return static_cast<int>(document_count * static_cast<int64_t>(range) / static_cast<int64_t>(range_count));
     };
+    // Splitting an impact traversal would make every range read the whole lists,
+    // so these segments are scored by tasks of their own after the ranges
+    std::vector<bool> is_by_impact(segment_terms.size());
+    std::vector<size_t> impact_segments;
+    for (size_t i = 0; i < segment_terms.size(); ++i) {
+        is_by_impact[i] = IsEvaluatedByImpact(segment_terms[i]);
+        if (is_by_impact[i]) {
+            impact_segments.push_back(i);
+        }
+    }
 
-    for (std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto & [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto &document_data = documents_.at(document_id);
-            if (!bad_documents.Contains(document_id) && document_predicate(document_id, document_data.status, document_data.rating)) {   
-                document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+    std::vector<TopDocuments> range_top_documents(range_count + impact_segments.size(), TopDocuments(max_count));
+    thread_pool_->ParallelFor(range_top_documents.size(), [&](size_t range) {
+        if (range >= range_count) {
+            const size_t i = impact_segments[range - range_count];
+            const IndexSegment& segment = index.GetSegment(i);
+            FindDocumentsInRange(replica, segment_terms[i], ordinal_filter, range_top_documents[range], segment.GetBegin(), segment.GetEnd());
+            return;
+        }
+        const int begin = range_begin(range);
+        const int end = range_begin(range + 1);
+        for (size_t i = 0; i < segment_terms.size(); ++i) {
+            const IndexSegment& segment = index.GetSegment(i);
+            if (!is_by_impact[i] && segment.GetBegin() < end && begin < segment.GetEnd()) {
+                FindDocumentsInRange(replica, segment_terms[i], ordinal_filter, range_top_documents[range],
+                    std::max(begin, segment.GetBegin()), std::min(end, segment.GetEnd()));
             }
         }
+    });
+
+    TopDocuments top_documents(max_count);
+    for (TopDocuments& range_top : range_top_documents) {
+        top_documents.Merge(std::move(range_top));
     }
+    return top_documents;
+}
 
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+template <typename OrdinalFilter>
+void SearchServer::FindDocumentsInRange(const IndexReplica& replica, const QueryTerms& terms, OrdinalFilter ordinal_filter, TopDocuments& top_documents, int begin, int end) const {
+    if (terms.plus_terms.empty()) {
+        return;
+    }
+    if (ranking_function_ == RankingFunction::BM25) {
+        FindRankedDocumentsInRange(Bm25Ranking(terms.average_word_count), replica, terms, ordinal_filter, top_documents, begin, end);
+    }
+    else {
+        FindRankedDocumentsInRange(TfIdfRanking(), replica, terms, ordinal_filter, top_documents, begin, end);
     }
-    return matched_documents;
 }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(query.plus_words.size());
-    ConcurrentSet<int> bad_documents(document_ids_.size());
-
-    std::for_each(std::execution::par, query.minus_words.begin(), query.minus_words.end(),
-        [this, &bad_documents](std::string_view word) {
-            if (word_to_document_freqs_.count(word) != 0) {
-                for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                    bad_documents.Insert(document_id);
-                }
-            }
-        });
+template <typename Ranking, typename OrdinalFilter>
+void SearchServer::FindRankedDocumentsInRange(const Ranking& ranking, const IndexReplica& replica, const QueryTerms& terms, OrdinalFilter ordinal_filter, TopDocuments& top_documents, int begin, int end) const {
+    if (IsEvaluatedByImpact(terms)) {
+        FindDocumentsByImpact(ranking, replica, terms, ordinal_filter, top_documents, begin, end);
+    }
+    else if (query_evaluation_ == QueryEvaluation::MAX_SCORE) {
+        FindDocumentsMaxScore(ranking, replica, terms, ordinal_filter, top_documents, begin, end);
+    }
+    else {
+        FindDocumentsExhaustive(ranking, replica, terms, ordinal_filter, top_documents, begin, end);
+    }
+}
 
-    static constexpr int PART_COUNT = 10;
-    const auto part_length = query.plus_words.size() / PART_COUNT;
-    auto part_begin = query.plus_words.begin();
-    auto part_end = std::next(part_begin, part_length);
+template <typename Ranking, typename OrdinalFilter>
+void SearchServer::FindDocumentsExhaustive(const Ranking& ranking, const IndexReplica& replica, const QueryTerms& terms, OrdinalFilter ordinal_filter, TopDocuments& top_documents, int begin, int end) const {
+    std::vector<double> relevances(end - begin, NOT_MATCHED);
+    for (const ScoringTerm& term : terms.plus_terms) {
+        PostingList::Cursor cursor(*term.postings);
+        for (cursor.SkipTo(begin); !cursor.AtEnd() && cursor.GetDocumentId() < end; cursor.Next()) {
+            const int ordinal = cursor.GetDocumentId();
+            double& relevance = relevances[ordinal - begin];
+            relevance = std::max(relevance, 0.0)
+                + ranking.ComputeRelevance(cursor.GetTermFreq(), term.inverse_document_freq, replica.documents[ordinal].word_count);
+        }
+    }
+    for (const PostingList* postings : terms.minus_postings) {
+        PostingList::Cursor cursor(*postings);
+        for (cursor.SkipTo(begin); !cursor.AtEnd() && cursor.GetDocumentId() < end; cursor.Next()) {
+            relevances[cursor.GetDocumentId() - begin] = NOT_MATCHED;
+        }
+    }
 
-    auto function = [&](const std::string_view& word) {
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            if (!bad_documents.Contains(document_id)) {
-                document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-            }
+    for (int ordinal = begin; ordinal < end; ++ordinal) {
+        const double relevance = relevances[ordinal - begin];
+        if (relevance != NOT_MATCHED && ordinal_filter(ordinal)) {
+            top_documents.Add({ replica.documents[ordinal].id, relevance, replica.document_columns.GetRating(ordinal) });
         }
+    }
+}
+
+template <typename Ranking, typename OrdinalFilter>
+void SearchServer::FindDocumentsMaxScore(const Ranking& ranking, const IndexReplica& replica, const QueryTerms& terms, OrdinalFilter ordinal_filter, TopDocuments& top_documents, int begin, int end) const {
+    struct TermCursor {
+        PostingList::Cursor cursor;
+        double inverse_document_freq;
+        double max_relevance;
     };
 
-    std::vector<std::future<void>> futures;
-    for (int i = 0;	i < PART_COUNT;	++i,
-        part_begin = part_end, part_end = (i == PART_COUNT - 1 ? query.plus_words.end() : next(part_begin, part_length))) {
-        futures.push_back(std::async([function, part_begin, part_end] {
-            std::for_each(part_begin, part_end, function);
-            }));
+    std::vector<TermCursor> term_cursors;
+    for (const ScoringTerm& term : terms.plus_terms) {
+        term_cursors.push_back({ PostingList::Cursor(*term.postings), term.inverse_document_freq,
+            ranking.ComputeMaxRelevance(term.postings->GetMaxTermFreq(), term.inverse_document_freq) });
+        term_cursors.back().cursor.SkipTo(begin);
     }
-    for (int i = 0; i < futures.size(); ++i) {
-        futures[i].get();
+    std::vector<PostingList::Cursor> minus_cursors;
+    for (const PostingList* postings : terms.minus_postings) {
+        minus_cursors.emplace_back(*postings);
+    }
+
+    // max_relevance_sums[i] bounds the relevance a document gets from terms [0, i]
+    std::sort(term_cursors.begin(), term_cursors.end(), [](const TermCursor& lhs, const TermCursor& rhs) {
+        return lhs.max_relevance < rhs.max_relevance;
+    });
+    std::vector<double> max_relevance_sums(term_cursors.size());
+    double max_relevance_sum = 0.0;
+    for (size_t i = 0; i < term_cursors.size(); ++i) {
+        max_relevance_sum += term_cursors[i].max_relevance;
+        max_relevance_sums[i] = max_relevance_sum;
+    }
+
+    // Documents below the threshold cannot displace the worst kept one
+    double threshold = -std::numeric_limits<double>::infinity();
+    // Terms before first_essential cannot lift a document over the threshold on their own
+    size_t first_essential = 0;
+    // Relevances closer than RELEVANCE_EPSILON tie and are ordered by rating
+    const auto raise_threshold = [&] {
+        threshold = top_documents.GetWorst().relevance - RELEVANCE_EPSILON - RELEVANCE_BOUND_SLACK;
+        first_essential = std::lower_bound(max_relevance_sums.begin(), max_relevance_sums.end(), threshold) - max_relevance_sums.begin();
+    };
+    if (top_documents.IsFull()) {
+        raise_threshold();
+    }
+
+    while (true) {
+        int ordinal = end;
+        for (size_t i = first_essential; i < term_cursors.size(); ++i) {
+            const PostingList::Cursor& cursor = term_cursors[i].cursor;
+            if (!cursor.AtEnd() && cursor.GetDocumentId() < ordinal) {
+                ordinal = cursor.GetDocumentId();
+            }
+        }
+        if (ordinal == end) {
+            break;
+        }
+
+        const uint32_t word_count = replica.documents[ordinal].word_count;
+        double relevance = 0.0;
+        for (size_t i = first_essential; i < term_cursors.size(); ++i) {
+            PostingList::Cursor& cursor = term_cursors[i].cursor;
+            if (!cursor.AtEnd() && cursor.GetDocumentId() == ordinal) {
+                relevance += ranking.ComputeRelevance(cursor.GetTermFreq(), term_cursors[i].inverse_document_freq, word_count);
+                cursor.Next();
+            }
+        }
+        // Filtered out documents are not scored further
+        if (!ordinal_filter(ordinal)) {
+            continue;
+        }
+        bool is_pruned = false;
+        for (size_t i = first_essential; i-- > 0;) {
+            if (relevance + max_relevance_sums[i] < threshold) {
+                is_pruned = true;
+                break;
+            }
+            PostingList::Cursor& cursor = term_cursors[i].cursor;
+            cursor.SkipTo(ordinal);
+            if (!cursor.AtEnd() && cursor.GetDocumentId() == ordinal) {
+                relevance += ranking.ComputeRelevance(cursor.GetTermFreq(), term_cursors[i].inverse_document_freq, word_count);
+            }
+        }
+        if (is_pruned) {
+            continue;
+        }
+
+        const bool is_excluded = std::any_of(minus_cursors.begin(), minus_cursors.end(), [ordinal](PostingList::Cursor& cursor) {
+            cursor.SkipTo(ordinal);
+            return !cursor.AtEnd() && cursor.GetDocumentId() == ordinal;
+        });
+        if (is_excluded) {
+            continue;
+        }
+
+        top_documents.Add({ replica.documents[ordinal].id, relevance, replica.document_columns.GetRating(ordinal) });
+        if (top_documents.IsFull()) {
+            raise_threshold();
+        }
+    }
+}
+
+template <typename Ranking, typename OrdinalFilter>
+void SearchServer::FindDocumentsByImpact(const Ranking& ranking, const IndexReplica& replica, const QueryTerms& terms, OrdinalFilter ordinal_filter, TopDocuments& top_documents, int begin, int end) const {
+    struct ImpactCursor {
+        const std::vector<PostingList::Impact>* impacts;
+        size_t index;
+        double inverse_document_freq;
+    };
+    // Bounds the relevance of the postings left in the cursor
+    const auto get_max_relevance = [&ranking](const ImpactCursor& cursor) {
+        return cursor.index < cursor.impacts->size() ? ranking.ComputeMaxRelevance((*cursor.impacts)[cursor.index].term_freq, cursor.inverse_document_freq) : 0.0;
+    };
+    std::vector<ImpactCursor> cursors;
+    for (const ScoringTerm& term : terms.plus_terms) {
+        cursors.push_back({ &term.postings->GetImpacts(), 0, term.inverse_document_freq });
     }
+    // A document is scored in full when its best posting comes up
+    std::unordered_set<int> scored_ordinals;
+
+    while (true) {
+        // A document not scored yet scores at most the sum of the current postings
+        double max_relevance = 0.0;
+        size_t best = cursors.size();
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            const double score = get_max_relevance(cursors[i]);
+            max_relevance += score;
+            if (cursors[i].index < cursors[i].impacts->size() && (best == cursors.size() || score > get_max_relevance(cursors[best]))) {
+                best = i;
+            }
+        }
+        if (best == cursors.size()) {
+            break;
+        }
+        // Relevances closer than RELEVANCE_EPSILON tie and are ordered by rating
+        if (top_documents.IsFull() && max_relevance < top_documents.GetWorst().relevance - RELEVANCE_EPSILON - RELEVANCE_BOUND_SLACK) {
+            break;
+        }
 
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+        const PostingList::Impact& impact = (*cursors[best].impacts)[cursors[best].index++];
+        const int ordinal = impact.document_id;
+        if (ordinal < begin || ordinal >= end) {
+            continue;
+        }
+        if (cursors.size() > 1 && !scored_ordinals.insert(ordinal).second) {
+            continue;
+        }
+        if (!ordinal_filter(ordinal)) {
+            continue;
+        }
+        const uint32_t word_count = replica.documents[ordinal].word_count;
+        double relevance = 0.0;
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            const double term_freq = i == best ? impact.term_freq : terms.plus_terms[i].postings->FindTermFreq(ordinal);
+            if (term_freq > 0.0) {
+                relevance += ranking.ComputeRelevance(term_freq, cursors[i].inverse_document_freq, word_count);
+            }
+        }
+        const bool is_excluded = std::any_of(terms.minus_postings.begin(), terms.minus_postings.end(), [ordinal](const PostingList* postings) {
+            return postings->Contains(ordinal);
+        });
+        if (!is_excluded) {
+            top_documents.Add({ replica.documents[ordinal].id, relevance, replica.document_columns.GetRating(ordinal) });
+        }
     }
-    return matched_documents;
 }
 
 template<typename ExecutionPolicy>
 void SearchServer::RemoveDocument(const ExecutionPolicy& policy, int document_id) {
-    if (document_ids_.count(document_id) > 0) {
-        document_ids_.erase(document_id);
-        documents_.erase(document_id);
-        document_to_word_freqs_.erase(document_id);
+    std::unique_lock lock(writer_mutex_);
+    const auto& document_ordinals = replicas_[0]->document_ordinals;
+    const auto ordinal_it = document_ordinals.find(document_id);
+    if (ordinal_it == document_ordinals.end()) {
+        return;
+    }
+    const int ordinal = ordinal_it->second;
+    const std::shared_ptr<WriteAheadLog> log = write_ahead_log_;
+    const uint64_t log_sequence = log ? log->LogRemoveDocument(document_id) : 0;
+    ModifyReplicas([&](IndexReplica& replica) {
+        InvertedIndex& index = replica.word_to_document_freqs;
+        if (removal_mode_ == RemovalMode::DEFERRED || index.IsSealed(ordinal)) {
+            MarkDocumentRemoved(replica, document_id, ordinal);
+            return;
+        }
+        const TermFreqRange term_freqs = replica.documents[ordinal].GetTermFreqs();
+        ForEachIndex(policy, term_freqs.size(), [&index, &term_freqs, ordinal](size_t i) {
+            index.Erase(term_freqs[i].term_id, ordinal);
+        });
+        index.EraseDocument();
+        RemoveDocumentData(replica, document_id, ordinal);
+    });
+    ++generation_;
+    document_ids_.erase(document_id);
+    StartMergesIfNeeded();
+    lock.unlock();
+    if (log) {
+        log->Sync(log_sequence);
+    }
+}
 
-        std::for_each(policy, word_to_document_freqs_.begin(), word_to_document_freqs_.end(),
-            [document_id](auto& word_freqs) {
-                if (word_freqs.second.count(document_id) > 0) {
-                    word_freqs.second.erase(document_id);
-                }
-            });
+template<typename ExecutionPolicy, typename DocumentIds>
+void SearchServer::RemoveDocuments(const ExecutionPolicy& policy, const DocumentIds& document_ids) {
+    std::unique_lock lock(writer_mutex_);
+    const auto& document_ordinals = replicas_[0]->document_ordinals;
+    std::vector<std::pair<int, int>> removed_documents;
+    for (const int document_id : document_ids) {
+        const auto ordinal_it = document_ordinals.find(document_id);
+        if (ordinal_it != document_ordinals.end()) {
+            removed_documents.emplace_back(document_id, ordinal_it->second);
+        }
+    }
+    // Repeated ids are removed once
+    std::sort(removed_documents.begin(), removed_documents.end());
+    removed_documents.erase(std::unique(removed_documents.begin(), removed_documents.end()), removed_documents.end());
+    if (removed_documents.empty()) {
+        return;
+    }
+    const std::shared_ptr<WriteAheadLog> log = write_ahead_log_;
+    uint64_t log_sequence = 0;
+    if (log) {
+        std::vector<int> logged_ids;
+        for (const auto& [document_id, ordinal] : removed_documents) {
+            logged_ids.push_back(document_id);
+        }
+        log_sequence = log->LogRemoveDocuments(logged_ids);
+    }
+
+    ModifyReplicas([&](IndexReplica& replica) {
+        // Documents of the mutable segment are erased in the IMMEDIATE mode, the rest are marked removed
+        InvertedIndex& index = replica.word_to_document_freqs;
+        std::unordered_map<int, std::vector<int>> term_to_ordinals;
+        std::vector<std::pair<int, int>> erased_documents;
+        for (const auto& [document_id, ordinal] : removed_documents) {
+            if (removal_mode_ == RemovalMode::DEFERRED || index.IsSealed(ordinal)) {
+                MarkDocumentRemoved(replica, document_id, ordinal);
+                continue;
+            }
+            erased_documents.emplace_back(document_id, ordinal);
+            for (const auto& [term_id, term_freq] : replica.documents[ordinal].GetTermFreqs()) {
+                term_to_ordinals[term_id].push_back(ordinal);
+            }
+        }
+
+        std::vector<std::pair<int, std::vector<int>>> erasures(
+            std::make_move_iterator(term_to_ordinals.begin()), std::make_move_iterator(term_to_ordinals.end()));
+        ForEachIndex(policy, erasures.size(), [&index, &erasures](size_t i) {
+            auto& [term_id, ordinals] = erasures[i];
+            std::sort(ordinals.begin(), ordinals.end());
+            index.Erase(term_id, ordinals);
+        });
+        for (const auto& [document_id, ordinal] : erased_documents) {
+            index.EraseDocument();
+            RemoveDocumentData(replica, document_id, ordinal);
+        }
+    });
+    ++generation_;
+    for (const auto& [document_id, ordinal] : removed_documents) {
+        document_ids_.erase(document_id);
+    }
+    StartMergesIfNeeded();
+    lock.unlock();
+    if (log) {
+        log->Sync(log_sequence);
     }
 }
 
+template<typename DocumentIds>
+void SearchServer::RemoveDocuments(const DocumentIds& document_ids) {
+    RemoveDocuments(std::execution::seq, document_ids);
+}
+
 template<typename ExecutionPolicy>
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const ExecutionPolicy& policy, std::string_view raw_query, int document_id) const {
     const auto query = ParseQuery(raw_query);
+    return ReadReplica([&](const IndexReplica& replica) -> std::tuple<std::vector<std::string_view>, DocumentStatus> {
+        const int ordinal = replica.document_ordinals.at(document_id);
+        const DocumentData& document = replica.documents[ordinal];
+        const DocumentStatus status = replica.document_columns.GetStatus(ordinal);
 
-    if (std::any_of(policy, query.minus_words.begin(), query.minus_words.end(), [document_id, this](std::string_view word) {
-        return this->word_to_document_freqs_.count(word) != 0 && this->word_to_document_freqs_.at(word).count(document_id) > 0; })) {
-        return { {}, documents_.at(document_id).status };
-    }
+        // Looks the term id up in the forward index of the document
+        const TermFreqRange term_freqs = document.GetTermFreqs();
+        const TermDictionary& terms = replica.word_to_document_freqs.GetTerms();
+        const auto contains_document = [&term_freqs, &terms](std::string_view word) {
+            return term_freqs.Find(terms.Find(word)) != nullptr;
+        };
 
-    std::vector<std::string_view> matched_words;
+        const WordSet& minus_words = query.minus_words;
+        std::atomic<bool> has_minus_word = false;
+        ForEachIndex(policy, minus_words.Size(), [&](size_t i) {
+            if (contains_document(minus_words[i])) {
+                has_minus_word = true;
+            }
+        });
+        if (has_minus_word) {
+            return { std::vector<std::string_view>{}, status };
+        }
+        // A document missing a phrase or NEAR/k matches no words
+        PositionalTerms positional_terms;
+        std::vector<std::vector<uint32_t>> positions;
+        if (!FindPositionalTerms(replica, query, positional_terms) || !HasPositionalTerms(replica, positional_terms, ordinal, positions)) {
+            return { std::vector<std::string_view>{}, status };
+        }
 
-    std::copy_if(query.plus_words.begin(), query.plus_words.end(), std::back_inserter(matched_words),
-        [document_id, this](std::string_view word) {
-            return (this->word_to_document_freqs_.count(word) != 0 && this->word_to_document_freqs_.at(word).count(document_id) > 0);
+        // Plus-words come sorted and unique from the query
+        const WordSet& plus_words = query.plus_words;
+        std::vector<char> is_matched(plus_words.Size());
+        ForEachIndex(policy, plus_words.Size(), [&](size_t i) {
+            is_matched[i] = contains_document(plus_words[i]);
         });
 
-    std::sort(policy, matched_words.begin(), matched_words.end());
-    std::unique(policy, matched_words.begin(), matched_words.end());
+        std::vector<std::string_view> matched_words;
+        for (size_t i = 0; i < plus_words.Size(); ++i) {
+            if (is_matched[i]) {
+                matched_words.push_back(plus_words[i]);
+            }
+        }
+        return { matched_words, status };
+    });
+}
 
-    return { matched_words, documents_.at(document_id).status };
+template <typename Function>
+auto SearchServer::ReadReplica(Function function) const {
+    if (read_concurrency_ == ReadConcurrency::LOCKING) {
+        std::unique_lock gate(index_gate_mutex_);
+        std::shared_lock lock(index_mutex_);
+        gate.unlock();
+        return function(static_cast<const IndexReplica&>(*replicas_[0]));
+    }
+    // A writer switches readers to the other replica before it waits for the readers of
+    // this one, so a reader that counted itself in too late backs off and retries
+    size_t index = read_index_.load();
+    while (true) {
+        reader_counts_[index].fetch_add(1);
+        const size_t current_index = read_index_.load();
+        if (current_index == index) {
+            break;
+        }
+        reader_counts_[index].fetch_sub(1);
+        index = current_index;
+    }
+    struct ReaderGuard {
+        std::atomic<size_t>& reader_count;
+        ~ReaderGuard() {
+            reader_count.fetch_sub(1);
+        }
+    } guard{ reader_counts_[index] };
+    return function(static_cast<const IndexReplica&>(*replicas_[index]));
+}
+
+template <typename Function>
+void SearchServer::ModifyReplicas(Function function) {
+    if (read_concurrency_ == ReadConcurrency::LOCKING) {
+        std::unique_lock gate(index_gate_mutex_);
+        std::unique_lock lock(index_mutex_);
+        gate.unlock();
+        function(*replicas_[0]);
+        return;
+    }
+    // Readers left the other replica when they were last switched to this one
+    const size_t index = read_index_.load();
+    IndexReplica& updated = *replicas_[1 - index];
+    function(updated);
+    read_index_.store(1 - index);
+    WaitForReaders(index);
+    function(*replicas_[index]);
+    replicas_[index]->word_to_document_freqs.ShareSegments(updated.word_to_document_freqs);
+}
+
+template <typename ExecutionPolicy, typename Function>
+void SearchServer::ForEachIndex(const ExecutionPolicy&, size_t count, Function function) const {
+    if constexpr (std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>) {
+        thread_pool_->ParallelFor(count, function);
+    }
+    else {
+        for (size_t i = 0; i < count; ++i) {
+            function(i);
+        }
+    }
 }
\ No newline at end of file
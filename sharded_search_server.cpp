@@ -0,0 +1,87 @@
+#include "sharded_search_server.h"
+
+#include <cstdint>
+
+using namespace std;
+
+ShardedSearchServer::ShardedSearchServer(size_t shard_count, string_view stop_words)
+    : ShardedSearchServer(shard_count, SplitIntoWords(stop_words)) {
+}
+
+void ShardedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    if (document_id < 0) {
+        throw invalid_argument("Invalid document_id"s);
+    }
+    shards_[GetShardIndex(document_id)]->AddDocument(document_id, document, status, ratings);
+}
+
+void ShardedSearchServer::AddDocuments(const vector<NewDocument>& documents) {
+    vector<vector<NewDocument>> shard_documents(shards_.size());
+    for (const NewDocument& document : documents) {
+        if (document.id < 0) {
+            throw invalid_argument("Invalid document_id"s);
+        }
+        shard_documents[GetShardIndex(document.id)].push_back(document);
+    }
+    thread_pool_->ParallelFor(shards_.size(), [this, &shard_documents](size_t i) {
+        shards_[i]->AddDocuments(shard_documents[i]);
+    });
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    if (document_id >= 0) {
+        shards_[GetShardIndex(document_id)]->RemoveDocument(document_id);
+    }
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, size_t max_count) const {
+    return FindTopDocuments(raw_query, DocumentFilter::ForStatus(status), max_count);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+tuple<vector<string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(string_view raw_query, int document_id) const {
+    if (document_id < 0) {
+        throw out_of_range("Invalid document_id"s);
+    }
+    return shards_[GetShardIndex(document_id)]->MatchDocument(raw_query, document_id);
+}
+
+map<string_view, double> ShardedSearchServer::GetWordFrequencies(int document_id) const {
+    if (document_id < 0) {
+        return {};
+    }
+    return shards_[GetShardIndex(document_id)]->GetWordFrequencies(document_id);
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    int document_count = 0;
+    for (const auto& shard : shards_) {
+        document_count += shard->GetDocumentCount();
+    }
+    return document_count;
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+    return shards_.size();
+}
+
+SearchServer& ShardedSearchServer::GetShard(size_t index) {
+    return *shards_.at(index);
+}
+
+const SearchServer& ShardedSearchServer::GetShard(size_t index) const {
+    return *shards_.at(index);
+}
+
+void ShardedSearchServer::SetThreadPool(shared_ptr<ThreadPool> thread_pool) {
+    thread_pool_ = move(thread_pool);
+}
+
+//private:
+size_t ShardedSearchServer::GetShardIndex(int document_id) const {
+    // Multiplicative hashing spreads ids of any stride over the shards
+    return static_cast<size_t>((static_cast<uint64_t>(document_id) * 0x9E3779B97F4A7C15ull) >> 32) % shards_.size();
+}
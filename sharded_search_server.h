@@ -0,0 +1,85 @@
+#pragma once
+
+#include "search_server.h"
+#include "thread_pool.h"
+#include "top_documents.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// Partitions documents by id hash over independent SearchServer shards, each
+// with its own locks. Queries collect the statistics of all shards first, then
+// run on every shard in parallel with the inverse document frequencies of the
+// whole collection, so the merged results rank as a single server's would.
+class ShardedSearchServer {
+public:
+    template <typename StringContainer>
+    ShardedSearchServer(size_t shard_count, const StringContainer& stop_words);
+    ShardedSearchServer(size_t shard_count, std::string_view stop_words);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // Shards add their parts of the batch in parallel; a part with an invalid
+    // document is not added, the parts of other shards are
+    void AddDocuments(const std::vector<NewDocument>& documents);
+    void RemoveDocument(int document_id);
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate, size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status, size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+    // Runs on the shard of the document
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+    int GetDocumentCount() const;
+
+    size_t GetShardCount() const;
+    // Shards are configured one by one, e.g. their encoding or read concurrency
+    SearchServer& GetShard(size_t index);
+    const SearchServer& GetShard(size_t index) const;
+
+    // Pool the shards are queried and modified on, ThreadPool::GetDefault() unless replaced
+    void SetThreadPool(std::shared_ptr<ThreadPool> thread_pool);
+
+private:
+    std::vector<std::unique_ptr<SearchServer>> shards_;
+    std::shared_ptr<ThreadPool> thread_pool_ = ThreadPool::GetDefault();
+
+    size_t GetShardIndex(int document_id) const;
+};
+
+template <typename StringContainer>
+ShardedSearchServer::ShardedSearchServer(size_t shard_count, const StringContainer& stop_words) {
+    using namespace std::string_literals;
+    if (shard_count == 0) {
+        throw std::invalid_argument("Shard count must be positive"s);
+    }
+    shards_.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.push_back(std::make_unique<SearchServer>(stop_words));
+    }
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate, size_t max_count) const {
+    CollectionStats stats;
+    for (const auto& shard : shards_) {
+        shard->AddCollectionStats(raw_query, stats);
+    }
+    std::vector<std::vector<Document>> shard_documents(shards_.size());
+    thread_pool_->ParallelFor(shards_.size(), [&](size_t i) {
+        shard_documents[i] = shards_[i]->FindTopDocuments(std::execution::seq, raw_query, document_predicate, max_count, stats);
+    });
+
+    TopDocuments top_documents(max_count);
+    for (const std::vector<Document>& documents : shard_documents) {
+        for (const Document& document : documents) {
+            top_documents.Add(document);
+        }
+    }
+    return std::move(top_documents).Build();
+}
@@ -1,19 +1,98 @@
 #include "string_processing.h"
 
+#include <cstring>
 #include <iostream>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_SERVER_X86_SIMD
+#include <immintrin.h>
+#endif
+
 using namespace std;
 
-vector<string_view> SplitIntoWords(string_view text) {
-    vector<string_view> words;
-    const int64_t pos_end = text.npos;
-    while (true) {
-        int64_t space = text.find(' ', 0);
-        words.push_back(space == pos_end ? text.substr(0) : text.substr(0, space));
-        text.remove_prefix(space + 1);
-        if (space == pos_end) {
-            break;
+namespace {
+
+BlockMasks ScanBlockScalar(const char* block, size_t size) {
+    BlockMasks masks;
+    for (size_t i = 0; i < size; ++i) {
+        const unsigned char c = static_cast<unsigned char>(block[i]);
+        masks.spaces |= uint64_t{ c == ' ' } << i;
+        masks.control_chars |= uint64_t{ c < ' ' } << i;
+    }
+    return masks;
+}
+
+#ifdef SEARCH_SERVER_X86_SIMD
+// Both take a full block; bytes are compared unsigned, so only 0-31 are control characters
+__attribute__((target("sse2")))
+BlockMasks ScanFullBlockSse2(const char* block) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i max_control_char = _mm_set1_epi8(' ' - 1);
+    BlockMasks masks;
+    for (size_t i = 0; i < MASK_BLOCK_SIZE; i += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+        const uint64_t spaces = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, space)));
+        const uint64_t control_chars = static_cast<uint32_t>(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_min_epu8(bytes, max_control_char), bytes)));
+        masks.spaces |= spaces << i;
+        masks.control_chars |= control_chars << i;
+    }
+    return masks;
+}
+
+__attribute__((target("avx2")))
+BlockMasks ScanFullBlockAvx2(const char* block) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i max_control_char = _mm256_set1_epi8(' ' - 1);
+    BlockMasks masks;
+    for (size_t i = 0; i < MASK_BLOCK_SIZE; i += 32) {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+        const uint64_t spaces = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, space)));
+        const uint64_t control_chars = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, max_control_char), bytes)));
+        masks.spaces |= spaces << i;
+        masks.control_chars |= control_chars << i;
+    }
+    return masks;
+}
+
+using ScanFullBlock = BlockMasks (*)(const char*);
+
+ScanFullBlock ChooseScanFullBlock() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return ScanFullBlockAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return ScanFullBlockSse2;
+    }
+    return nullptr;
+}
+#endif
+
+} // namespace
+
+BlockMasks ScanBlock(const char* block, size_t size) {
+#ifdef SEARCH_SERVER_X86_SIMD
+    static const ScanFullBlock scan_full_block = ChooseScanFullBlock();
+    if (scan_full_block) {
+        if (size == MASK_BLOCK_SIZE) {
+            return scan_full_block(block);
         }
+        // The tail is padded with a byte that is neither a space nor a control character
+        char padded_block[MASK_BLOCK_SIZE];
+        memset(padded_block, 'a', MASK_BLOCK_SIZE);
+        memcpy(padded_block, block, size);
+        return scan_full_block(padded_block);
     }
+#endif
+    return ScanBlockScalar(block, size);
+}
+
+vector<string_view> SplitIntoWords(string_view text) {
+    vector<string_view> words;
+    ForEachWord(text, [&words](string_view word, bool) {
+        words.push_back(word);
+    });
     return words;
-}
\ No newline at end of file
+}
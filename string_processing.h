@@ -1,11 +1,62 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <set>
 #include <string_view>
 #include <vector>
 
 std::vector<std::string_view> SplitIntoWords(std::string_view text);
 
+// Bit i of spaces is set if block[i] is ' ', bit i of control_chars if block[i]
+// is a control character. Scans with AVX2 or SSE2 when the CPU supports them
+struct BlockMasks {
+    uint64_t spaces = 0;
+    uint64_t control_chars = 0;
+};
+constexpr size_t MASK_BLOCK_SIZE = 64;
+// size must not exceed MASK_BLOCK_SIZE
+BlockMasks ScanBlock(const char* block, size_t size);
+
+inline int CountTrailingZeros(uint64_t bits) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    int count = 0;
+    for (; (bits & 1) == 0; bits >>= 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+// Calls function(word, is_valid) for the words SplitIntoWords returns, without
+// allocating; is_valid is false if the word contains control characters. Words
+// are separated by runs of spaces and are never empty
+template <typename Function>
+void ForEachWord(std::string_view text, Function function) {
+    size_t word_begin = 0;
+    bool is_valid = true;
+    for (size_t block = 0; block < text.size(); block += MASK_BLOCK_SIZE) {
+        auto [spaces, control_chars] = ScanBlock(text.data() + block, std::min(MASK_BLOCK_SIZE, text.size() - block));
+        for (; spaces != 0; spaces &= spaces - 1) {
+            const int bit = CountTrailingZeros(spaces);
+            // Control characters before the space belong to the word
+            const uint64_t before_space = (uint64_t{ 1 } << bit) - 1;
+            is_valid = is_valid && (control_chars & before_space) == 0;
+            if (block + bit > word_begin) {
+                function(text.substr(word_begin, block + bit - word_begin), is_valid);
+            }
+            control_chars &= ~before_space;
+            word_begin = block + bit + 1;
+            is_valid = true;
+        }
+        is_valid = is_valid && control_chars == 0;
+    }
+    if (word_begin < text.size()) {
+        function(text.substr(word_begin), is_valid);
+    }
+}
 template <typename StringContainer>
 std::set<std::string_view> MakeUniqueNonEmptyStrings(StringContainer strings) {
     std::set<std::string_view> non_empty_strings;
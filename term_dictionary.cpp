@@ -0,0 +1,89 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+TermDictionary::TermDictionary(const TermDictionary& other)
+    : mapped_offsets_(other.mapped_offsets_)
+    , mapped_chars_(other.mapped_chars_)
+    , mapped_sorted_term_ids_(other.mapped_sorted_term_ids_)
+    , mapped_count_(other.mapped_count_) {
+    terms_.reserve(other.terms_.size());
+    term_ids_.reserve(other.term_ids_.size());
+    for (string_view term : other.terms_) {
+        Add(term);
+    }
+}
+
+void TermDictionary::SetMappedTerms(const uint64_t* offsets, const char* chars, const int32_t* sorted_term_ids, size_t count) {
+    mapped_offsets_ = offsets;
+    mapped_chars_ = chars;
+    mapped_sorted_term_ids_ = sorted_term_ids;
+    mapped_count_ = count;
+}
+
+int TermDictionary::Add(string_view term) {
+    if (const int term_id = FindMapped(term); term_id != NO_TERM) {
+        return term_id;
+    }
+    const auto it = term_ids_.find(term);
+    if (it != term_ids_.end()) {
+        return it->second;
+    }
+    const int term_id = static_cast<int>(mapped_count_ + terms_.size());
+    terms_.push_back(Store(term));
+    term_ids_.emplace(terms_.back(), term_id);
+    return term_id;
+}
+
+int TermDictionary::Find(string_view term) const {
+    if (const int term_id = FindMapped(term); term_id != NO_TERM) {
+        return term_id;
+    }
+    const auto it = term_ids_.find(term);
+    return it == term_ids_.end() ? NO_TERM : it->second;
+}
+
+string_view TermDictionary::GetTerm(int term_id) const {
+    const size_t index = static_cast<size_t>(term_id);
+    if (index < mapped_count_) {
+        return { mapped_chars_ + mapped_offsets_[index], mapped_offsets_[index + 1] - mapped_offsets_[index] };
+    }
+    return terms_[index - mapped_count_];
+}
+
+size_t TermDictionary::Size() const {
+    return mapped_count_ + terms_.size();
+}
+
+int TermDictionary::FindMapped(string_view term) const {
+    const int32_t* const end = mapped_sorted_term_ids_ + mapped_count_;
+    const int32_t* const it = lower_bound(mapped_sorted_term_ids_, end, term, [this](int32_t term_id, string_view value) {
+        return GetTerm(term_id) < value;
+    });
+    return it != end && GetTerm(*it) == term ? *it : NO_TERM;
+}
+
+string_view TermDictionary::Store(string_view term) {
+    if (term.empty()) {
+        return {};
+    }
+    // Long terms get a chunk of their own instead of wasting the current one
+    if (term.size() > CHUNK_SIZE / 16) {
+        chunks_.push_back(make_unique<char[]>(term.size()));
+        memcpy(chunks_.back().get(), term.data(), term.size());
+        return { chunks_.back().get(), term.size() };
+    }
+    if (term.size() > free_size_) {
+        chunks_.push_back(make_unique<char[]>(CHUNK_SIZE));
+        free_ = chunks_.back().get();
+        free_size_ = CHUNK_SIZE;
+    }
+    memcpy(free_, term.data(), term.size());
+    const string_view stored(free_, term.size());
+    free_ += term.size();
+    free_size_ -= term.size();
+    return stored;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Stores every distinct term once in an arena of large chunks and numbers
+// terms densely in the order they are added. Terms are never removed, so
+// term ids and the views returned by GetTerm stay valid. The first terms may
+// be read from mapped tables instead, which are searched in place.
+class TermDictionary {
+public:
+    static constexpr int NO_TERM = -1;
+
+    TermDictionary() = default;
+    // Shares the mapped tables and stores the other terms again in an arena of
+    // its own, keeping their ids
+    TermDictionary(const TermDictionary& other);
+    TermDictionary& operator=(const TermDictionary&) = delete;
+
+    // Takes count terms with ids from 0 from tables it does not own, which must
+    // outlive the dictionary: term i is chars[offsets[i], offsets[i + 1]) and
+    // sorted_term_ids orders the ids by term. The dictionary must be empty
+    void SetMappedTerms(const uint64_t* offsets, const char* chars, const int32_t* sorted_term_ids, size_t count);
+
+    // Returns the id of the term, adding the term if it is new
+    int Add(std::string_view term);
+    // Returns NO_TERM if the term was never added
+    int Find(std::string_view term) const;
+    std::string_view GetTerm(int term_id) const;
+    size_t Size() const;
+
+private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    // Terms with ids below mapped_count_
+    const uint64_t* mapped_offsets_ = nullptr;
+    const char* mapped_chars_ = nullptr;
+    const int32_t* mapped_sorted_term_ids_ = nullptr;
+    size_t mapped_count_ = 0;
+
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    // Unused tail of the current chunk
+    char* free_ = nullptr;
+    size_t free_size_ = 0;
+    // Indexed by term id - mapped_count_, views into chunks_
+    std::vector<std::string_view> terms_;
+    std::unordered_map<std::string_view, int> term_ids_;
+
+    // Binary search in the mapped terms
+    int FindMapped(std::string_view term) const;
+    // Copies the term into the arena
+    std::string_view Store(std::string_view term);
+};
@@ -0,0 +1,101 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+// Pool and queue index of the worker running on the current thread
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_queue = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    thread_count = max<size_t>(thread_count, 1);
+    for (size_t i = 0; i < thread_count; ++i) {
+        queues_.push_back(make_unique<TaskQueue>());
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back([this, i] {
+            RunWorker(i);
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard guard(sleep_mutex_);
+        is_stopping_ = true;
+    }
+    wake_up_.notify_all();
+    for (thread& worker : threads_) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::GetThreadCount() const {
+    return threads_.size();
+}
+
+shared_ptr<ThreadPool> ThreadPool::GetDefault() {
+    static const shared_ptr<ThreadPool> pool = make_shared<ThreadPool>(thread::hardware_concurrency());
+    return pool;
+}
+
+void ThreadPool::Push(Task task) {
+    const size_t queue = current_pool == this ? current_queue : next_queue_++ % queues_.size();
+    {
+        lock_guard guard(queues_[queue]->mutex);
+        queues_[queue]->tasks.push_back(move(task));
+    }
+    ++pending_count_;
+    {
+        lock_guard guard(sleep_mutex_);
+    }
+    wake_up_.notify_one();
+}
+
+bool ThreadPool::TryRunTask() {
+    const size_t own_queue = current_pool == this ? current_queue : 0;
+    Task task;
+    for (size_t i = 0; i < queues_.size() && !task; ++i) {
+        TaskQueue& queue = *queues_[(own_queue + i) % queues_.size()];
+        lock_guard guard(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else {
+            task = move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    --pending_count_;
+    task();
+    return true;
+}
+
+void ThreadPool::RunWorker(size_t index) {
+    current_pool = this;
+    current_queue = index;
+    while (true) {
+        if (TryRunTask()) {
+            continue;
+        }
+        unique_lock lock(sleep_mutex_);
+        wake_up_.wait(lock, [this] {
+            return is_stopping_ || pending_count_ > 0;
+        });
+        if (is_stopping_ && pending_count_ == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads with a task deque per worker. Workers take
+// their own newest tasks first and steal the oldest tasks of others when
+// idle. A ParallelFor caller runs the indexes of its own call that no worker
+// has taken and then sleeps; it never runs other tasks, which may need locks
+// the caller holds. Nested calls from pool tasks still finish, because every
+// taken index is run by a thread that does not wait for it.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t thread_count);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    size_t GetThreadCount() const;
+
+    template <typename Function>
+    std::future<std::invoke_result_t<Function>> Submit(Function function);
+
+    // Calls function(i) for every i in [0, count) and waits for all of them;
+    // the first exception thrown by function is rethrown. The calling thread
+    // takes part in the call and only in it
+    template <typename Function>
+    void ParallelFor(size_t count, Function function);
+
+    // Process-wide pool with one thread per hardware thread
+    static std::shared_ptr<ThreadPool> GetDefault();
+
+private:
+    using Task = std::function<void()>;
+
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> pending_count_ = 0;
+    std::atomic<size_t> next_queue_ = 0;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_up_;
+    bool is_stopping_ = false;
+
+    void Push(Task task);
+    // Runs one queued task if there is any
+    bool TryRunTask();
+    void RunWorker(size_t index);
+};
+
+template <typename Function>
+std::future<std::invoke_result_t<Function>> ThreadPool::Submit(Function function) {
+    auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Function>()>>(std::move(function));
+    auto result = task->get_future();
+    Push([task] {
+        (*task)();
+    });
+    return result;
+}
+
+template <typename Function>
+void ThreadPool::ParallelFor(size_t count, Function function) {
+    if (count == 0) {
+        return;
+    }
+    // Helper tasks may start after the loop is over, so they share state by pointer
+    struct State {
+        std::atomic<size_t> next_index = 0;
+        std::atomic<size_t> done_count = 0;
+        std::mutex mutex;
+        std::condition_variable done;
+        std::exception_ptr exception;
+    };
+    const auto state = std::make_shared<State>();
+    const auto run = [state, count, &function] {
+        for (size_t index = state->next_index++; index < count; index = state->next_index++) {
+            try {
+                function(index);
+            }
+            catch (...) {
+                std::lock_guard guard(state->mutex);
+                if (!state->exception) {
+                    state->exception = std::current_exception();
+                }
+            }
+            if (++state->done_count == count) {
+                {
+                    std::lock_guard guard(state->mutex);
+                }
+                state->done.notify_all();
+            }
+        }
+    };
+
+    const size_t helper_count = std::min(count - 1, threads_.size());
+    for (size_t i = 0; i < helper_count; ++i) {
+        Push(run);
+    }
+    // Every index is taken once run returns; the ones taken by workers are running
+    run();
+    std::unique_lock lock(state->mutex);
+    state->done.wait(lock, [&state, count] {
+        return state->done_count == count;
+    });
+    if (state->exception) {
+        std::rethrow_exception(state->exception);
+    }
+}
@@ -0,0 +1,54 @@
+#include "top_documents.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (abs(lhs.relevance - rhs.relevance) < RELEVANCE_EPSILON) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+TopDocuments::TopDocuments(size_t max_count)
+    : max_count_(max_count) {
+    heap_.reserve(min(max_count, MAX_RESERVED_COUNT));
+}
+
+void TopDocuments::Add(const Document& document) {
+    if (heap_.size() < max_count_) {
+        heap_.push_back(document);
+        push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+    else if (max_count_ > 0 && IsMoreRelevant(document, heap_.front())) {
+        pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        heap_.back() = document;
+        push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+}
+
+void TopDocuments::Merge(TopDocuments&& other) {
+    for (const Document& document : other.heap_) {
+        Add(document);
+    }
+    other.heap_.clear();
+}
+
+size_t TopDocuments::Size() const {
+    return heap_.size();
+}
+
+bool TopDocuments::IsFull() const {
+    return heap_.size() >= max_count_;
+}
+
+const Document& TopDocuments::GetWorst() const {
+    return heap_.front();
+}
+
+vector<Document> TopDocuments::Build() && {
+    sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    return move(heap_);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "document.h"
+
+#include <vector>
+
+const double RELEVANCE_EPSILON = 1e-6;
+// Pruning compares upper bounds summed in another order than the relevances
+// they bound, so rounding may leave a bound a little below the relevance;
+// pruning thresholds are lowered by this much beyond RELEVANCE_EPSILON
+const double RELEVANCE_BOUND_SLACK = 1e-9;
+
+// Ranking order of search results: higher relevance first, ties within
+// RELEVANCE_EPSILON are broken by higher rating.
+bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+// Keeps the best max_count documents seen so far in a bounded heap whose
+// top is the worst kept document.
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t max_count);
+
+    void Add(const Document& document);
+    void Merge(TopDocuments&& other);
+
+    size_t Size() const;
+    bool IsFull() const;
+    // Valid only if the accumulator is not empty
+    const Document& GetWorst() const;
+
+    // Returns kept documents sorted with IsMoreRelevant
+    std::vector<Document> Build() &&;
+
+private:
+    // Larger heaps grow as documents come, so a large max_count costs nothing up front
+    static constexpr size_t MAX_RESERVED_COUNT = 1024;
+
+    size_t max_count_;
+    std::vector<Document> heap_;
+};
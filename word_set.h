@@ -0,0 +1,66 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <string_view>
+#include <vector>
+
+// Sorted set of distinct words kept as views. The first INLINE_CAPACITY words
+// are stored in the object itself, so small sets never allocate; a larger set
+// moves to the heap.
+class WordSet {
+public:
+    static constexpr size_t INLINE_CAPACITY = 16;
+
+    void Insert(std::string_view word) {
+        std::string_view* words = GetData();
+        std::string_view* position = std::lower_bound(words, words + size_, word);
+        if (position != words + size_ && *position == word) {
+            return;
+        }
+        if (!heap_words_.empty()) {
+            heap_words_.insert(heap_words_.begin() + (position - words), word);
+        }
+        else if (size_ < INLINE_CAPACITY) {
+            std::move_backward(position, words + size_, words + size_ + 1);
+            *position = word;
+        }
+        else {
+            heap_words_.reserve(INLINE_CAPACITY * 2);
+            heap_words_.assign(words, position);
+            heap_words_.push_back(word);
+            heap_words_.insert(heap_words_.end(), position, words + size_);
+        }
+        ++size_;
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+    bool Empty() const {
+        return size_ == 0;
+    }
+
+    std::string_view operator[](size_t index) const {
+        return begin()[index];
+    }
+
+    const std::string_view* begin() const {
+        return heap_words_.empty() ? inline_words_.data() : heap_words_.data();
+    }
+
+    const std::string_view* end() const {
+        return begin() + size_;
+    }
+
+private:
+    std::array<std::string_view, INLINE_CAPACITY> inline_words_;
+    // Holds all the words once the inline storage is exceeded
+    std::vector<std::string_view> heap_words_;
+    size_t size_ = 0;
+
+    std::string_view* GetData() {
+        return heap_words_.empty() ? inline_words_.data() : heap_words_.data();
+    }
+};
@@ -0,0 +1,352 @@
+#include "write_ahead_log.h"
+#include "search_server.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// Size and checksum of the payload
+constexpr size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+uint32_t ComputeChecksum(const char* data, size_t size) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+// Takes the next framed record off records; false if it is cut off or its
+// checksum does not match
+bool TakeRecord(string_view& records, string_view& payload) {
+    uint32_t header[2];
+    if (records.size() < RECORD_HEADER_SIZE) {
+        return false;
+    }
+    memcpy(header, records.data(), sizeof(header));
+    if (header[0] > records.size() - RECORD_HEADER_SIZE) {
+        return false;
+    }
+    payload = records.substr(RECORD_HEADER_SIZE, header[0]);
+    records.remove_prefix(RECORD_HEADER_SIZE + header[0]);
+    return ComputeChecksum(payload.data(), payload.size()) == header[1];
+}
+
+template <typename Value>
+void AppendValue(string& out, Value value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Reads values from a record payload, failing on the first read past its end
+class PayloadReader {
+public:
+    PayloadReader(const char* data, size_t size)
+        : data_(data)
+        , end_(data + size) {
+    }
+
+    template <typename Value>
+    bool Read(Value& value) {
+        if (static_cast<size_t>(end_ - data_) < sizeof(value)) {
+            return false;
+        }
+        memcpy(&value, data_, sizeof(value));
+        data_ += sizeof(value);
+        return true;
+    }
+
+    bool Read(string_view& text, size_t size) {
+        if (static_cast<size_t>(end_ - data_) < size) {
+            return false;
+        }
+        text = string_view(data_, size);
+        data_ += size;
+        return true;
+    }
+
+    bool AtEnd() const {
+        return data_ == end_;
+    }
+
+private:
+    const char* data_;
+    const char* end_;
+};
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(const string& path)
+    : path_(path)
+    , fd_(open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644)) {
+    if (fd_ < 0) {
+        throw system_error(errno, generic_category(), "Cannot open log "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd_, &file_stat) != 0) {
+        const int error = errno;
+        close(fd_);
+        throw system_error(error, generic_category(), "Cannot open log "s + path);
+    }
+    size_ = static_cast<uint64_t>(file_stat.st_size);
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    close(fd_);
+}
+
+uint64_t WriteAheadLog::LogAddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    string records;
+    AppendAddDocument(records, document_id, document, status, ratings);
+    return Append(records);
+}
+
+uint64_t WriteAheadLog::LogRemoveDocument(int document_id) {
+    string records;
+    AppendRemoveDocument(records, document_id);
+    return Append(records);
+}
+
+uint64_t WriteAheadLog::LogAddDocuments(const vector<NewDocument>& documents) {
+    string records;
+    for (const NewDocument& document : documents) {
+        AppendAddDocument(records, document.id, document.text, document.status, document.ratings);
+    }
+    string batch;
+    AppendBatch(batch, records);
+    return Append(batch);
+}
+
+uint64_t WriteAheadLog::LogRemoveDocuments(const vector<int>& document_ids) {
+    string records;
+    for (const int document_id : document_ids) {
+        AppendRemoveDocument(records, document_id);
+    }
+    string batch;
+    AppendBatch(batch, records);
+    return Append(batch);
+}
+
+uint64_t WriteAheadLog::GetSize() const {
+    lock_guard guard(mutex_);
+    return size_;
+}
+
+void WriteAheadLog::Replay(const string& path, SearchServer& search_server) {
+    ifstream in(path, ios::binary);
+    if (!in) {
+        return;
+    }
+    in.seekg(0, ios::end);
+    const uint64_t file_size = static_cast<uint64_t>(in.tellg());
+    in.seekg(0);
+    uint64_t valid_size = 0;
+    string payload;
+    while (true) {
+        uint32_t header[2];
+        if (!in.read(reinterpret_cast<char*>(header), sizeof(header))
+            || header[0] > file_size - valid_size - RECORD_HEADER_SIZE) {
+            break;
+        }
+        payload.resize(header[0]);
+        if (!in.read(payload.data(), payload.size()) || ComputeChecksum(payload.data(), payload.size()) != header[1]) {
+            break;
+        }
+
+        RecordType type;
+        NewDocument document;
+        if (!payload.empty() && static_cast<RecordType>(payload.front()) == RecordType::BATCH) {
+            if (!ReplayBatch(string_view(payload).substr(sizeof(RecordType)), search_server)) {
+                break;
+            }
+        }
+        else if (!ReadDocumentRecord(payload, type, document)) {
+            break;
+        }
+        else if (type == RecordType::ADD_DOCUMENT) {
+            search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+        else {
+            search_server.RemoveDocument(document.id);
+        }
+        valid_size += RECORD_HEADER_SIZE + payload.size();
+    }
+
+    in.close();
+    if (truncate(path.c_str(), static_cast<off_t>(valid_size)) != 0) {
+        throw system_error(errno, generic_category(), "Cannot truncate log "s + path);
+    }
+}
+
+bool WriteAheadLog::ReadDocumentRecord(string_view payload, RecordType& type, NewDocument& document) {
+    PayloadReader reader(payload.data(), payload.size());
+    int32_t document_id = 0;
+    if (!reader.Read(type) || !reader.Read(document_id)) {
+        return false;
+    }
+    document.id = document_id;
+    if (type == RecordType::REMOVE_DOCUMENT) {
+        return reader.AtEnd();
+    }
+    if (type != RecordType::ADD_DOCUMENT) {
+        return false;
+    }
+    int32_t status = 0;
+    uint32_t rating_count = 0;
+    if (!reader.Read(status) || status < 0 || static_cast<size_t>(status) >= DOCUMENT_STATUS_COUNT
+        || !reader.Read(rating_count) || rating_count > payload.size() / sizeof(int32_t)) {
+        return false;
+    }
+    document.status = static_cast<DocumentStatus>(status);
+    document.ratings.resize(rating_count);
+    for (int& rating : document.ratings) {
+        int32_t value = 0;
+        if (!reader.Read(value)) {
+            return false;
+        }
+        rating = value;
+    }
+    uint32_t text_size = 0;
+    return reader.Read(text_size) && reader.Read(document.text, text_size) && reader.AtEnd();
+}
+
+bool WriteAheadLog::ReplayBatch(string_view records, SearchServer& search_server) {
+    // Nothing is applied before the whole batch is read
+    vector<NewDocument> added_documents;
+    vector<int> removed_ids;
+    while (!records.empty()) {
+        string_view payload;
+        RecordType type;
+        NewDocument document;
+        if (!TakeRecord(records, payload) || !ReadDocumentRecord(payload, type, document)) {
+            return false;
+        }
+        if (type == RecordType::ADD_DOCUMENT) {
+            added_documents.push_back(move(document));
+        }
+        else {
+            removed_ids.push_back(document.id);
+        }
+    }
+    if (!added_documents.empty() && !removed_ids.empty()) {
+        return false;
+    }
+    if (!added_documents.empty()) {
+        search_server.AddDocuments(added_documents);
+    }
+    else if (!removed_ids.empty()) {
+        search_server.RemoveDocuments(removed_ids);
+    }
+    return true;
+}
+
+void WriteAheadLog::AppendAddDocument(string& out, int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    const size_t payload_begin = out.size() + RECORD_HEADER_SIZE;
+    out.resize(payload_begin);
+    AppendValue(out, RecordType::ADD_DOCUMENT);
+    AppendValue(out, static_cast<int32_t>(document_id));
+    AppendValue(out, static_cast<int32_t>(status));
+    AppendValue(out, static_cast<uint32_t>(ratings.size()));
+    for (const int rating : ratings) {
+        AppendValue(out, static_cast<int32_t>(rating));
+    }
+    AppendValue(out, static_cast<uint32_t>(document.size()));
+    out.append(document);
+    FinishRecord(out, payload_begin);
+}
+
+void WriteAheadLog::AppendRemoveDocument(string& out, int document_id) {
+    const size_t payload_begin = out.size() + RECORD_HEADER_SIZE;
+    out.resize(payload_begin);
+    AppendValue(out, RecordType::REMOVE_DOCUMENT);
+    AppendValue(out, static_cast<int32_t>(document_id));
+    FinishRecord(out, payload_begin);
+}
+
+void WriteAheadLog::AppendBatch(string& out, const string& records) {
+    const size_t payload_begin = out.size() + RECORD_HEADER_SIZE;
+    out.resize(payload_begin);
+    AppendValue(out, RecordType::BATCH);
+    out += records;
+    FinishRecord(out, payload_begin);
+}
+
+void WriteAheadLog::FinishRecord(string& out, size_t payload_begin) {
+    const size_t payload_size = out.size() - payload_begin;
+    const uint32_t header[2] = {
+        static_cast<uint32_t>(payload_size),
+        ComputeChecksum(out.data() + payload_begin, payload_size),
+    };
+    memcpy(out.data() + payload_begin - RECORD_HEADER_SIZE, header, sizeof(header));
+}
+
+uint64_t WriteAheadLog::Append(const string& records) {
+    lock_guard guard(mutex_);
+    if (error_) {
+        rethrow_exception(error_);
+    }
+    pending_ += records;
+    size_ += records.size();
+    return ++logged_count_;
+}
+
+void WriteAheadLog::Sync(uint64_t sequence) {
+    unique_lock lock(mutex_);
+    while (synced_count_ < sequence) {
+        if (error_) {
+            rethrow_exception(error_);
+        }
+        if (is_syncing_) {
+            synced_.wait(lock);
+            continue;
+        }
+        // Writes everything pending, including records of threads waiting for the running sync
+        is_syncing_ = true;
+        string batch;
+        batch.swap(pending_);
+        const uint64_t batch_end = logged_count_;
+        lock.unlock();
+        try {
+            WriteAndSync(batch);
+        }
+        catch (...) {
+            lock.lock();
+            error_ = current_exception();
+            is_syncing_ = false;
+            synced_.notify_all();
+            throw;
+        }
+        lock.lock();
+        synced_count_ = batch_end;
+        is_syncing_ = false;
+        synced_.notify_all();
+    }
+}
+
+void WriteAheadLog::WriteAndSync(const string& records) {
+    const char* data = records.data();
+    size_t size = records.size();
+    while (size > 0) {
+        const ssize_t written = write(fd_, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw system_error(errno, generic_category(), "Cannot write log "s + path_);
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    if (fdatasync(fd_) != 0) {
+        throw system_error(errno, generic_category(), "Cannot sync log "s + path_);
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "document.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class SearchServer;
+
+// Append-only file of index mutations. Every record is framed with its size
+// and checksum, so a torn tail left by a crash is detected and dropped. A
+// batch is framed as one record holding its records, so it is replayed whole
+// or not at all.
+// The Log methods only queue records in order and return their sequence
+// number; Sync makes them durable. Records queued by the time a sync starts
+// are written and synced together (group commit).
+class WriteAheadLog {
+public:
+    // Opens the file for appending, creating it if needed;
+    // throws system_error if that fails
+    explicit WriteAheadLog(const std::string& path);
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+    ~WriteAheadLog();
+
+    // Throw the error of a failed write or sync, after which nothing is logged
+    uint64_t LogAddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    uint64_t LogRemoveDocument(int document_id);
+    // Batches take one sequence number and one record
+    uint64_t LogAddDocuments(const std::vector<NewDocument>& documents);
+    uint64_t LogRemoveDocuments(const std::vector<int>& document_ids);
+
+    // Blocks until the records up to the sequence number are written and synced;
+    // the calling thread writes all queued records if no sync is running.
+    // Throws system_error if writing fails
+    void Sync(uint64_t sequence);
+
+    // Size of the file in bytes including records not synced yet
+    uint64_t GetSize() const;
+
+    // Applies the complete records of the file to the server, which must have
+    // no log attached, and truncates the file after the last complete record
+    static void Replay(const std::string& path, SearchServer& search_server);
+
+private:
+    enum class RecordType : uint8_t {
+        ADD_DOCUMENT = 1,
+        REMOVE_DOCUMENT = 2,
+        // Framed ADD_DOCUMENT or REMOVE_DOCUMENT records of one kind
+        BATCH = 3,
+    };
+
+    std::string path_;
+    int fd_ = -1;
+
+    mutable std::mutex mutex_;
+    std::condition_variable synced_;
+    // Records waiting for the next write
+    std::string pending_;
+    uint64_t size_ = 0;
+    // Log calls are numbered; the ones up to synced_count_ are durable
+    uint64_t logged_count_ = 0;
+    uint64_t synced_count_ = 0;
+    bool is_syncing_ = false;
+    std::exception_ptr error_;
+
+    static void AppendAddDocument(std::string& out, int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    static void AppendRemoveDocument(std::string& out, int document_id);
+    static void AppendBatch(std::string& out, const std::string& records);
+    // Frames the payload appended to out since payload_begin, which is left for the frame header
+    static void FinishRecord(std::string& out, size_t payload_begin);
+
+    // Reads an ADD_DOCUMENT or REMOVE_DOCUMENT payload, of which removals only
+    // fill the id; the text of the document points into the payload
+    static bool ReadDocumentRecord(std::string_view payload, RecordType& type, NewDocument& document);
+    // Applies the records of a batch payload after its type if they are all
+    // valid, returns false otherwise
+    static bool ReplayBatch(std::string_view records, SearchServer& search_server);
+
+    // Queues the records, returns their sequence number
+    uint64_t Append(const std::string& records);
+    void WriteAndSync(const std::string& records);
+};